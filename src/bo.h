@@ -26,6 +26,7 @@
 #define _BO_H_
 
 struct omap_bo;
+struct omap_bo_range;
 struct omap_device;
 enum omap_gem_op;
 struct bo_ops {
@@ -35,8 +36,18 @@ struct bo_ops {
 	void (*bo_destroy)(struct omap_bo *bo);
 	int (*bo_get_name)(struct omap_bo *bo, uint32_t *name);
 	void *(*bo_map)(struct omap_bo *bo);
-	int (*bo_cpu_prep)(struct omap_bo *bo, enum omap_gem_op op);
-	int (*bo_cpu_fini)(struct omap_bo *bo, enum omap_gem_op op);
+	/* @range is the part of the bo about to be accessed; a backend
+	 * which can only prepare all of it widens @range to match
+	 */
+	int (*bo_cpu_prep)(struct omap_bo *bo, enum omap_gem_op op,
+			   struct omap_bo_range *range);
+	/* @range covers everything prepared since the first bo_cpu_prep */
+	int (*bo_cpu_fini)(struct omap_bo *bo, enum omap_gem_op op,
+			   const struct omap_bo_range *range);
+	/* Optional: wait for the GPU without preparing; has to be thread
+	 * safe
+	 */
+	int (*bo_cpu_wait)(struct omap_bo *bo, enum omap_gem_op op);
 };
 
 int bo_device_init(struct omap_device *dev);
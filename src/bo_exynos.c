@@ -93,7 +93,9 @@ static void *bo_exynos_map(struct omap_bo *bo)
 	return exynos_bo_map(bo->priv_bo);
 }
 
-static int bo_exynos_cpu_prep(struct omap_bo *bo, enum omap_gem_op op)
+/* The acquire ioctl has no range, so it always covers the whole bo */
+static int bo_exynos_cpu_prep(struct omap_bo *bo, enum omap_gem_op op,
+		struct omap_bo_range *range)
 {
 	ScrnInfoPtr pScrn = bo->dev->pScrn;
 	struct drm_exynos_gem_cpu_acquire acquire;
@@ -108,10 +110,14 @@ static int bo_exynos_cpu_prep(struct omap_bo *bo, enum omap_gem_op op)
 	if (ret)
 		ERROR_MSG("DRM_IOCTL_EXYNOS_GEM_CPU_ACQUIRE failed: %s",
 				strerror(errno));
+
+	range->offset = 0;
+	range->size = bo->pitch * bo->height;
 	return ret;
 }
 
-static int bo_exynos_cpu_fini(struct omap_bo *bo, enum omap_gem_op op)
+static int bo_exynos_cpu_fini(struct omap_bo *bo, enum omap_gem_op op,
+		const struct omap_bo_range *range)
 {
 	ScrnInfoPtr pScrn = bo->dev->pScrn;
 	struct drm_exynos_gem_cpu_release release;
@@ -22,9 +22,13 @@
  *
  */
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 #include <xorg-server.h>
 #include <xf86.h>
 #include <xf86drm.h>
@@ -33,11 +37,60 @@
 #include "omap_dumb.h"
 #include "omap_msg.h"
 
+#ifdef HAVE_LINUX_DMA_BUF_H
+#include <linux/dma-buf.h>
+#endif
+
+/* Kernel headers older than 4.6 don't have the sync ioctl yet */
+#ifndef DMA_BUF_IOCTL_SYNC
+struct dma_buf_sync {
+	uint64_t flags;
+};
+
+#define DMA_BUF_SYNC_READ	(1 << 0)
+#define DMA_BUF_SYNC_WRITE	(2 << 0)
+#define DMA_BUF_SYNC_RW		(DMA_BUF_SYNC_READ | DMA_BUF_SYNC_WRITE)
+#define DMA_BUF_SYNC_START	(0 << 2)
+#define DMA_BUF_SYNC_END	(1 << 2)
+
+#define DMA_BUF_BASE		'b'
+#define DMA_BUF_IOCTL_SYNC	_IOW(DMA_BUF_BASE, 0, struct dma_buf_sync)
+#endif
+
+/* Rockchip kernels can also sync just part of a buffer */
+struct dma_buf_sync_partial {
+	uint64_t flags;
+	uint32_t offset;
+	uint32_t len;
+};
+
+#define DMA_BUF_IOCTL_SYNC_PARTIAL \
+	_IOW(DMA_BUF_BASE, 8, struct dma_buf_sync_partial)
+
+/* Older libdrm lacks DRM_RDWR, which is just O_RDWR */
+#ifndef DRM_RDWR
+#define DRM_RDWR O_RDWR
+#endif
+
+struct rockchip_bo {
+	struct kms_bo *kms_bo;
+	/* the bo exported while the CPU accesses it, else -1; not kept
+	 * open all the time, as every pixmap would hold a file descriptor
+	 */
+	int dmabuf_fd;
+};
+
+/* What the kernel turned out to support, for all bos */
+static Bool no_sync_partial;
+static Bool no_sync;
+static Bool export_warned;
+
 static void *bo_rockchip_create(struct omap_device *dev,
 				size_t width, size_t height, uint32_t flags,
 				uint32_t *handle, uint32_t *pitch)
 {
 	struct kms_driver *kms = dev->bo_dev;
+	struct rockchip_bo *rockchip_bo;
 	struct kms_bo *kms_bo;
 	unsigned attr[7];
 
@@ -52,18 +105,31 @@ static void *bo_rockchip_create(struct omap_device *dev,
 	if (kms_bo_create(kms, attr, &kms_bo))
 		return NULL;
 
-	if (kms_bo_get_prop(kms_bo, KMS_HANDLE, handle))
-		return NULL;
+	if (kms_bo_get_prop(kms_bo, KMS_HANDLE, handle) ||
+	    kms_bo_get_prop(kms_bo, KMS_PITCH, pitch))
+		goto destroy_kms_bo;
 
-	if (kms_bo_get_prop(kms_bo, KMS_PITCH, pitch))
-		return NULL;
+	rockchip_bo = calloc(1, sizeof(*rockchip_bo));
+	if (!rockchip_bo)
+		goto destroy_kms_bo;
 
-	return kms_bo;
+	rockchip_bo->kms_bo = kms_bo;
+	rockchip_bo->dmabuf_fd = -1;
+	return rockchip_bo;
+
+destroy_kms_bo:
+	kms_bo_destroy(&kms_bo);
+	return NULL;
 }
 
 static void bo_rockchip_destroy(struct omap_bo *bo)
 {
-	kms_bo_destroy((struct kms_bo **)&bo->priv_bo);
+	struct rockchip_bo *rockchip_bo = bo->priv_bo;
+
+	if (rockchip_bo->dmabuf_fd >= 0)
+		close(rockchip_bo->dmabuf_fd);
+	kms_bo_destroy(&rockchip_bo->kms_bo);
+	free(rockchip_bo);
 }
 
 static int bo_rockchip_get_name(struct omap_bo *bo, uint32_t *name)
@@ -87,20 +153,167 @@ static void *bo_rockchip_map(struct omap_bo *bo)
 {
 	void *map_addr;
 
-	if (kms_bo_map(bo->priv_bo, &map_addr))
+	struct rockchip_bo *rockchip_bo = bo->priv_bo;
+
+	if (kms_bo_map(rockchip_bo->kms_bo, &map_addr))
 		return NULL;
 
 	return map_addr;
 }
 
-static int bo_rockchip_cpu_prep(struct omap_bo *bo, enum omap_gem_op op)
+/* The bo as a dma-buf, or -1 if it can't be exported */
+static int bo_rockchip_dmabuf(struct omap_bo *bo)
 {
-	return 0;
+	ScrnInfoPtr pScrn = bo->dev->pScrn;
+	struct rockchip_bo *rockchip_bo = bo->priv_bo;
+
+	if (rockchip_bo->dmabuf_fd < 0 &&
+	    drmPrimeHandleToFD(bo->dev->fd, bo->handle,
+			       DRM_CLOEXEC | DRM_RDWR,
+			       &rockchip_bo->dmabuf_fd)) {
+		if (!export_warned)
+			WARNING_MSG("Couldn't export bo as dma-buf, CPU access "
+					"won't wait for the GPU: %s",
+					strerror(errno));
+		export_warned = TRUE;
+		rockchip_bo->dmabuf_fd = -1;
+	}
+
+	return rockchip_bo->dmabuf_fd;
 }
 
-static int bo_rockchip_cpu_fini(struct omap_bo *bo, enum omap_gem_op op)
+/* Is the GPU done with the dma-buf @fd, for CPU access with @op? */
+static int bo_rockchip_poll(int fd, enum omap_gem_op op, int timeout)
 {
-	return 0;
+	struct pollfd pfd = {
+		.fd = fd,
+		/* readable once there is no writer, writable once there are
+		 * no readers either
+		 */
+		.events = (op & OMAP_GEM_WRITE) ? POLLOUT : POLLIN,
+	};
+	int ret;
+
+	do {
+		ret = poll(&pfd, 1, timeout);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+	return ret;
+}
+
+/*
+ * Start or end CPU access to @range of the bo.  Starting waits for the GPU
+ * to finish writing the bo, and for a write also for it to finish reading
+ * it, then makes the CPU caches coherent with memory; ending writes back
+ * what the CPU wrote.  Only the bytes of @range get cache maintenance on
+ * kernels which can do that, otherwise @range is widened to the whole bo.
+ */
+static int bo_rockchip_sync(struct omap_bo *bo, uint64_t flags,
+		struct omap_bo_range *range)
+{
+	ScrnInfoPtr pScrn = bo->dev->pScrn;
+	uint32_t size = bo->pitch * bo->height;
+	int fd = bo_rockchip_dmabuf(bo);
+
+	if (fd < 0)
+		return 0;
+
+	if (!no_sync_partial && (range->offset || range->size < size)) {
+		struct dma_buf_sync_partial sync = {
+			.flags = flags,
+			.offset = range->offset,
+			.len = range->size,
+		};
+
+		if (!range->size ||
+		    !drmIoctl(fd, DMA_BUF_IOCTL_SYNC_PARTIAL, &sync))
+			return 0;
+		if (errno != ENOTTY && errno != EINVAL) {
+			ERROR_MSG("DMA_BUF_IOCTL_SYNC_PARTIAL failed: %s",
+					strerror(errno));
+			return -1;
+		}
+		no_sync_partial = TRUE;
+	}
+
+	range->offset = 0;
+	range->size = size;
+
+	if (!no_sync) {
+		struct dma_buf_sync sync = {
+			.flags = flags,
+		};
+
+		if (!drmIoctl(fd, DMA_BUF_IOCTL_SYNC, &sync))
+			return 0;
+		if (errno != ENOTTY) {
+			ERROR_MSG("DMA_BUF_IOCTL_SYNC failed: %s",
+					strerror(errno));
+			return -1;
+		}
+		no_sync = TRUE;
+	}
+
+	/* Kernels from before the sync ioctl can still wait for the GPU's
+	 * fences.  The mapping is write-combined on those, so there is no
+	 * cache to take care of.
+	 */
+	if (flags & DMA_BUF_SYNC_END)
+		return 0;
+
+	return bo_rockchip_poll(fd, (flags & DMA_BUF_SYNC_WRITE) ?
+			OMAP_GEM_WRITE : OMAP_GEM_READ, -1) < 0 ? -1 : 0;
+}
+
+static uint64_t bo_rockchip_sync_flags(enum omap_gem_op op)
+{
+	uint64_t flags = 0;
+
+	if (op & OMAP_GEM_READ)
+		flags |= DMA_BUF_SYNC_READ;
+	if (op & OMAP_GEM_WRITE)
+		flags |= DMA_BUF_SYNC_WRITE;
+	return flags;
+}
+
+static int bo_rockchip_cpu_prep(struct omap_bo *bo, enum omap_gem_op op,
+		struct omap_bo_range *range)
+{
+	return bo_rockchip_sync(bo, DMA_BUF_SYNC_START |
+			bo_rockchip_sync_flags(op), range);
+}
+
+/* Called from other threads: exports a dma-buf of its own to poll */
+static int bo_rockchip_cpu_wait(struct omap_bo *bo, enum omap_gem_op op)
+{
+	int fd, ret;
+
+	if (drmPrimeHandleToFD(bo->dev->fd, bo->handle, DRM_CLOEXEC, &fd))
+		return 0;
+
+	ret = bo_rockchip_poll(fd, op, -1);
+	close(fd);
+	return ret < 0 ? ret : 0;
+}
+
+/* Callers don't always pass the op to fini, so go by what was acquired */
+static int bo_rockchip_cpu_fini(struct omap_bo *bo, enum omap_gem_op op,
+		const struct omap_bo_range *range)
+{
+	struct rockchip_bo *rockchip_bo = bo->priv_bo;
+	struct omap_bo_range r = *range;
+	int ret;
+
+	if (rockchip_bo->dmabuf_fd < 0)
+		return 0;
+
+	ret = bo_rockchip_sync(bo, DMA_BUF_SYNC_END |
+			bo_rockchip_sync_flags(bo->acquired_exclusive ?
+				OMAP_GEM_READ | OMAP_GEM_WRITE :
+				OMAP_GEM_READ), &r);
+	close(rockchip_bo->dmabuf_fd);
+	rockchip_bo->dmabuf_fd = -1;
+	return ret;
 }
 
 static const struct bo_ops bo_rockchip_ops = {
@@ -110,6 +323,7 @@ static const struct bo_ops bo_rockchip_ops = {
 	.bo_map = bo_rockchip_map,
 	.bo_cpu_prep = bo_rockchip_cpu_prep,
 	.bo_cpu_fini = bo_rockchip_cpu_fini,
+	.bo_cpu_wait = bo_rockchip_cpu_wait,
 };
 
 int bo_device_init(struct omap_device *dev)
@@ -28,11 +28,22 @@
 #ifndef COMPAT_API_H
 #define COMPAT_API_H
 
+#include "xorgVersion.h"
+
 #ifndef GLYPH_HAS_GLYPH_PICTURE_ACCESSOR
 #define GetGlyphPicture(g, s) GlyphPicture((g))[(s)->myNum]
 #define SetGlyphPicture(g, s, p) GlyphPicture((g))[(s)->myNum] = p
 #endif
 
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,16,99,1,0)
+#define DamageUnregister(d, dd) DamageUnregister(dd)
+#endif
+
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1,18,99,1,0)
+#define input_lock() OsBlockSIGIO()
+#define input_unlock() OsReleaseSIGIO()
+#endif
+
 #ifndef XF86_HAS_SCRN_CONV
 #define xf86ScreenToScrn(s) xf86Screens[(s)->myNum]
 #define xf86ScrnToScreen(s) screenInfo.screens[(s)->scrnIndex]
@@ -47,6 +47,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <linux/fb.h>
 
@@ -75,12 +76,15 @@
 #include "xf86DDC.h"
 
 #include "region.h"
+#include "property.h"
 
 #include <X11/extensions/randr.h>
 
 #include <X11/extensions/dpmsconst.h>
 
 #include "omap_driver.h"
+#include "omap_copy.h"
+#include "omap_crc.h"
 
 #include "xf86Crtc.h"
 
@@ -91,18 +95,102 @@
 #include <sys/ioctl.h>
 #include <libudev.h>
 
+#ifndef DRM_CLIENT_CAP_WRITEBACK_CONNECTORS
+#define DRM_CLIENT_CAP_WRITEBACK_CONNECTORS	5
+#endif
+#ifndef DRM_MODE_CONNECTOR_WRITEBACK
+#define DRM_MODE_CONNECTOR_WRITEBACK	18
+#endif
+#ifndef DRM_CAP_CURSOR_WIDTH
+#define DRM_CAP_CURSOR_WIDTH	0x8
+#define DRM_CAP_CURSOR_HEIGHT	0x9
+#endif
+
+/* The cursor size of kernels that don't say */
+#define CURSORW  64
+#define CURSORH  64
+
+#define DRMMODE_WRITEBACK_BOS	3
+
+/*
+ * A writeback connector, capturing what @crtc displays into a ring of bos.
+ * @latest is the frame completed last and @pending the one being written
+ * until @fence signals, or -1 if there is none.
+ */
+typedef struct {
+	ScrnInfoPtr pScrn;
+	uint32_t id;
+	uint32_t possible_crtcs;
+	uint32_t crtc_id_prop;
+	uint32_t fb_id_prop;
+	uint32_t out_fence_prop;
+	xf86CrtcPtr crtc;
+	/* attached to @crtc, by the last modeset of it */
+	Bool attached;
+	struct omap_bo *bo[DRMMODE_WRITEBACK_BOS];
+	int latest;
+	int pending;
+	int32_t fence;
+	pointer fence_handler;
+	Bool fence_signaled;
+	uint32_t sequence;
+	/* the screen changed since the last capture was started */
+	Bool dirty;
+	Bool failed;
+} drmmode_writeback_rec, *drmmode_writeback_ptr;
+
 typedef struct {
 	int fd;
 	struct udev_monitor *uevent_monitor;
 	InputHandlerProc uevent_handler;
+	drmmode_writeback_ptr writeback;
+	int num_writeback;
+	/* what the hw cursor bos are, and SetCursor is told */
+	int cursor_width;
+	int cursor_height;
 } drmmode_rec, *drmmode_ptr;
 
 typedef struct {
 	drmmode_ptr drmmode;
 	uint32_t id;
-	struct omap_bo *cursor_bo;
+
+	/*
+	 * The cursor is double buffered: a new image goes into the bo that
+	 * isn't shown, which SetCursor then flips to.  cursor_hash[i] is the
+	 * hash of the image in cursor_bo[i], if cursor_loaded[i], so that
+	 * reloads of an image already in one of them skip the copy.
+	 */
+	struct omap_bo *cursor_bo[2];
+	uint64_t cursor_hash[2];
+	Bool cursor_loaded[2];
+	int cursor_front;
+	Bool cursor_shown;
+
+	/* where the cursor has moved to since the last MoveCursor, which
+	 * was at cursor_move_time, in GetTimeInMillis() time
+	 */
+	int cursor_x, cursor_y;
+	Bool cursor_moved;
+	CARD32 cursor_move_time;
+
+	/*
+	 * TearFree: in blit mode the crtc scans out of one of these bos,
+	 * while the other one is brought up to date with the root scanout.
+	 * tearfree_damage[i] is the part of the root scanout that has
+	 * changed since tearfree_bo[i] was last updated.
+	 */
+	struct omap_bo *tearfree_bo[2];
+	RegionRec tearfree_damage[2];
+	int tearfree_front;
+	Bool tearfree_flip_pending;
 } drmmode_crtc_private_rec, *drmmode_crtc_private_ptr;
 
+/*
+ * Page flip events carry either an OMAPDRISwapCmd or, for TearFree flips,
+ * the xf86CrtcPtr that was flipped, tagged with the low bit.
+ */
+#define DRMMODE_TEARFREE_FLIP	1UL
+
 typedef struct {
 	drmModePropertyPtr mode_prop;
 	int index; /* Index within the kernel-side property arrays for
@@ -124,6 +212,7 @@ typedef struct {
 
 static void drmmode_output_dpms(xf86OutputPtr output, int mode);
 
+/* Returns the id of property @name of type @flags, or of any type if 0 */
 static uint32_t
 drmmode_get_prop_id(int fd, uint32_t count_props, const uint32_t props[],
 		const char *name, uint32_t flags)
@@ -135,7 +224,8 @@ drmmode_get_prop_id(int fd, uint32_t count_props, const uint32_t props[],
 		drmModePropertyPtr prop = drmModeGetProperty(fd, props[i]);
 		if (!prop)
 			continue;
-		if (prop->flags == flags && !strcmp(prop->name, name))
+		if ((!flags || prop->flags == flags) &&
+				!strcmp(prop->name, name))
 			prop_id = props[i];
 		drmModeFreeProperty(prop);
 	}
@@ -159,8 +249,23 @@ drmmode_scanout_from_size(OMAPScanoutPtr scanouts, int x, int y, int width,
 static OMAPScanoutPtr
 drmmode_scanout_from_crtc(OMAPScanoutPtr scanouts, xf86CrtcPtr crtc)
 {
-	return drmmode_scanout_from_size(scanouts, crtc->x, crtc->y,
+	OMAPScanoutPtr s;
+
+	s = drmmode_scanout_from_size(scanouts, crtc->x, crtc->y,
 			crtc->mode.HDisplay, crtc->mode.VDisplay);
+	if (s && s->span)
+		return NULL;
+	return s;
+}
+
+static OMAPScanoutPtr drmmode_span_scanout(OMAPScanoutPtr scanouts)
+{
+	int i;
+	for (i = 0; i < MAX_SCANOUTS; i++) {
+		if (scanouts[i].bo && scanouts[i].span)
+			return &scanouts[i];
+	}
+	return NULL;
 }
 
 OMAPScanoutPtr
@@ -193,6 +298,82 @@ drmmode_scanout_add(OMAPScanoutPtr scanouts, xf86CrtcPtr crtc,
 	return NULL;
 }
 
+/*
+ * Returns TRUE if @pDraw covers exactly the bounding box of all enabled crtcs,
+ * and there are at least two of them.
+ */
+Bool drmmode_drawable_spans_crtcs(ScrnInfoPtr pScrn, DrawablePtr pDraw)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	int i, n = 0;
+
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+
+		if (!crtc->enabled || !crtc->mode.HDisplay ||
+				!crtc->mode.VDisplay)
+			continue;
+
+		if (!n || crtc->x < x1)
+			x1 = crtc->x;
+		if (!n || crtc->y < y1)
+			y1 = crtc->y;
+		if (!n || crtc->x + crtc->mode.HDisplay > x2)
+			x2 = crtc->x + crtc->mode.HDisplay;
+		if (!n || crtc->y + crtc->mode.VDisplay > y2)
+			y2 = crtc->y + crtc->mode.VDisplay;
+		n++;
+	}
+
+	return n > 1 && pDraw->x == x1 && pDraw->y == y1 &&
+			pDraw->width == x2 - x1 && pDraw->height == y2 - y1;
+}
+
+/*
+ * Returns the span scanout for @pDraw, allocating it on first use, or NULL if
+ * @pDraw does not span the crtcs.  It is dropped again on the next modeset.
+ */
+OMAPScanoutPtr
+drmmode_span_scanout_from_drawable(ScrnInfoPtr pScrn, DrawablePtr pDraw)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	OMAPScanoutPtr s;
+	struct omap_bo *bo;
+	int i;
+
+	if (!drmmode_drawable_spans_crtcs(pScrn, pDraw))
+		return NULL;
+
+	s = drmmode_span_scanout(pOMAP->scanouts);
+	if (s)
+		return s;
+
+	for (i = 0; i < MAX_SCANOUTS; i++) {
+		s = &pOMAP->scanouts[i];
+		if (!s->bo)
+			break;
+	}
+	if (i == MAX_SCANOUTS)
+		return NULL;
+
+	bo = omap_bo_new_with_depth(pOMAP->dev, pDraw->width, pDraw->height,
+			pScrn->depth, pScrn->bitsPerPixel);
+	if (!bo) {
+		ERROR_MSG("Span scanout buffer allocation failed");
+		return NULL;
+	}
+
+	s->x = pDraw->x;
+	s->y = pDraw->y;
+	s->width = pDraw->width;
+	s->height = pDraw->height;
+	s->bo = bo;
+	s->valid = FALSE;
+	s->span = TRUE;
+	return s;
+}
+
 void
 drmmode_scanout_set(OMAPScanoutPtr scanouts, int x, int y, struct omap_bo *bo)
 {
@@ -208,9 +389,10 @@ drmmode_scanout_set(OMAPScanoutPtr scanouts, int x, int y, struct omap_bo *bo)
 	omap_bo_reference(bo);
 	omap_bo_unreference(s->bo);
 	s->bo = bo;
+	s->in_root = FALSE;
 }
 
-static uint32_t drmmode_crtc_id(xf86CrtcPtr crtc)
+uint32_t drmmode_crtc_id(xf86CrtcPtr crtc)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	return drmmode_crtc->id;
@@ -318,6 +500,146 @@ drmmode_ConvertToKMode(ScrnInfoPtr pScrn, drmModeModeInfo *kmode,
 	kmode->name[DRM_DISPLAY_MODE_LEN-1] = 0;
 }
 
+/* The first enabled crtc @wb can capture */
+static xf86CrtcPtr
+drmmode_writeback_crtc(ScrnInfoPtr pScrn, drmmode_writeback_ptr wb)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int i;
+
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+
+		if (!(wb->possible_crtcs & (1 << i)))
+			continue;
+		if (crtc->enabled && crtc->mode.HDisplay &&
+				crtc->mode.VDisplay)
+			return crtc;
+	}
+
+	return NULL;
+}
+
+/*
+ * A legacy modeset only keeps the connectors it is given on @crtc, and
+ * attaching a writeback connector again would take a modeset of its own.
+ * So each modeset of @crtc passes the writeback connectors capturing it
+ * along: they are added to @ids, and their count returned.
+ */
+static int
+drmmode_writeback_ids(xf86CrtcPtr crtc, uint32_t *ids)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	int i, n = 0;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (!wb->failed && drmmode_writeback_crtc(crtc->scrn, wb) == crtc)
+			ids[n++] = wb->id;
+	}
+
+	return n;
+}
+
+/*
+ * Note what a modeset of @crtc left attached to it: the writeback
+ * connectors from drmmode_writeback_ids() if @attached, else none.
+ */
+static void
+drmmode_writeback_attached(xf86CrtcPtr crtc, Bool attached)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	int i;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (wb->failed)
+			continue;
+		if (attached && drmmode_writeback_crtc(crtc->scrn, wb) == crtc) {
+			wb->crtc = crtc;
+			wb->attached = TRUE;
+		} else if (wb->crtc == crtc) {
+			wb->attached = FALSE;
+		}
+	}
+}
+
+/* Stop trying to capture @crtc, when its modesets won't take writeback */
+static void
+drmmode_writeback_disable(xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	ScrnInfoPtr pScrn = crtc->scrn;
+	int i;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (wb->failed || drmmode_writeback_crtc(pScrn, wb) != crtc)
+			continue;
+		WARNING_MSG("[CONNECTOR:%u] [CRTC:%u] modeset with writeback failed, capture disabled",
+				wb->id, drmmode_crtc_id(crtc));
+		wb->failed = TRUE;
+		wb->attached = FALSE;
+	}
+}
+
+/*
+ * Whether a capture of @crtc is in flight.  Its nonblocking commit makes
+ * page flips of @crtc fail with EBUSY until then, so they are held back.
+ */
+static Bool
+drmmode_writeback_busy(xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	int i;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (wb->crtc == crtc && wb->pending >= 0 &&
+				!wb->fence_signaled)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * As drmmode_writeback_busy(), but for flips which can't be held back:
+ * wait for the capture to complete.  It is published from the block handler
+ * as usual.
+ */
+static void
+drmmode_writeback_wait(xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	struct pollfd pfd;
+	int i;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (wb->crtc != crtc || wb->pending < 0 || wb->fence_signaled)
+			continue;
+
+		pfd.fd = wb->fence;
+		pfd.events = POLLIN;
+		while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+			;
+		if (wb->fence_handler)
+			xf86DisableGeneralHandler(wb->fence_handler);
+		wb->fence_signaled = TRUE;
+	}
+}
+
 static void
 drmmode_crtc_dpms(xf86CrtcPtr drmmode_crtc, int mode)
 {
@@ -334,6 +656,7 @@ drmmode_set_crtc_off(xf86CrtcPtr crtc)
 
 	rc = drmModeSetCrtc(drmmode_crtc->drmmode->fd, crtc_id, 0, 0, 0, NULL,
 			0, NULL);
+	drmmode_writeback_attached(crtc, FALSE);
 	if (rc)
 		ERROR_MSG("[CRTC:%u] disable failed: %s", crtc_id,
 				strerror(errno));
@@ -350,14 +673,16 @@ drmmode_set_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc, struct omap_bo *bo, int x,
 	xf86OutputPtr output;
 	drmmode_crtc_private_ptr drmmode_crtc;
 	drmmode_output_private_ptr drmmode_output;
-	int rc, output_count, i;
+	drmmode_ptr drmmode = drmmode_from_scrn(pScrn);
+	int rc, output_count, writeback_count, i;
 	uint32_t *output_ids = NULL;
 	uint32_t fb_id;
 	uint32_t crtc_id = drmmode_crtc_id(crtc);
 	drmModeModeInfo kmode;
 	Bool ret;
 
-	output_ids = calloc(xf86_config->num_output, sizeof *output_ids);
+	output_ids = calloc(xf86_config->num_output + drmmode->num_writeback,
+			sizeof *output_ids);
 	assert(output_ids);
 
 	output_count = 0;
@@ -381,9 +706,18 @@ drmmode_set_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc, struct omap_bo *bo, int x,
 
 	drmmode_crtc = crtc->driver_private;
 	fb_id = omap_bo_fb(bo);
+	writeback_count = drmmode_writeback_ids(crtc,
+			output_ids + output_count);
 	/* drmModeSetCrtc returns non-zero on error; convert to Bool */
 	rc = drmModeSetCrtc(drmmode_crtc->drmmode->fd, crtc_id, fb_id, x, y,
-			output_ids, output_count, &kmode);
+			output_ids, output_count + writeback_count, &kmode);
+	if (rc && writeback_count) {
+		drmmode_writeback_disable(crtc);
+		writeback_count = 0;
+		rc = drmModeSetCrtc(drmmode_crtc->drmmode->fd, crtc_id, fb_id,
+				x, y, output_ids, output_count, &kmode);
+	}
+	drmmode_writeback_attached(crtc, !rc && writeback_count);
 	if (rc)
 		ERROR_MSG("[CRTC:%u] failed to set mode with [FB:%u] @ (%d, %d): %s",
 				crtc_id, fb_id, x, y, strerror(errno));
@@ -460,6 +794,10 @@ drmmode_copy_bo(ScrnInfoPtr pScrn, struct omap_bo *src_bo, int src_x, int src_y,
 
 	assert(omap_bo_bpp(src_bo) == omap_bo_bpp(dst_bo));
 
+	/* let queued 2-D operations on either bo finish first */
+	OMAPEXAWaitBo(pScrn, src_bo);
+	OMAPEXAWaitBo(pScrn, dst_bo);
+
 	src = omap_bo_map(src_bo);
 	if (!src) {
 		ERROR_MSG("Couldn't map src bo");
@@ -489,15 +827,282 @@ drmmode_copy_bo(ScrnInfoPtr pScrn, struct omap_bo *src_bo, int src_x, int src_y,
 	return TRUE;
 }
 
-static Bool drmmode_set_blit_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc)
+static void drmmode_crtc_box(xf86CrtcPtr crtc, BoxPtr box)
+{
+	box->x1 = crtc->x;
+	box->y1 = crtc->y;
+	box->x2 = crtc->x + crtc->mode.HDisplay;
+	box->y2 = crtc->y + crtc->mode.VDisplay;
+}
+
+/*
+ * Copy @box of @src to @dst, both given in root window coordinates, where
+ * the origin of @dst is at (@dst_x, @dst_y).
+ */
+static void
+drmmode_copy_box(const uint8_t *src, int src_pitch, uint8_t *dst,
+		int dst_pitch, int cpp, const BoxRec *box, int dst_x, int dst_y)
+{
+	src += box->y1 * src_pitch + box->x1 * cpp;
+	dst += (box->y1 - dst_y) * dst_pitch + (box->x1 - dst_x) * cpp;
+
+	omap_copy_rect(dst, dst_pitch, src, src_pitch,
+			(box->x2 - box->x1) * cpp, box->y2 - box->y1);
+}
+
+static void drmmode_tearfree_fini(xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		omap_bo_unreference(drmmode_crtc->tearfree_bo[i]);
+		drmmode_crtc->tearfree_bo[i] = NULL;
+		RegionEmpty(&drmmode_crtc->tearfree_damage[i]);
+	}
+}
+
+/*
+ * Bring TearFree bo @index of @crtc up to date with the root pixmap,
+ * copying only what changed since it was last updated.
+ *
+ * With ShadowFB, copy from the shadow rather than the root scanout: it is
+ * cheaper to read, and reading it to checksum tiles lets us skip those
+ * that were damaged but did not actually change.
+ */
+static Bool
+drmmode_tearfree_copy(ScrnInfoPtr pScrn, xf86CrtcPtr crtc, int index)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	struct omap_bo *bo = drmmode_crtc->tearfree_bo[index];
+	RegionPtr pRegion = &drmmode_crtc->tearfree_damage[index];
+	struct omap_bo *src_bo = NULL;
+	struct omap_crc_tiles *tiles = NULL;
+	int src_pitch = omap_bo_pitch(pOMAP->scanout);
+	struct omap_bo_range range, src_range;
+	const uint8_t *src;
+	uint8_t *dst;
+	BoxPtr pBox;
+	int i, n;
+
+	n = RegionNumRects(pRegion);
+	if (!n)
+		return TRUE;
+
+	if (pOMAP->shadow_fb) {
+		src = pOMAP->shadow;
+		tiles = omap_bo_crc_tiles(bo);
+	} else {
+		src_bo = pOMAP->scanout;
+		OMAPEXAWaitBo(pScrn, src_bo);
+		src = omap_bo_map(src_bo);
+	}
+	dst = omap_bo_map(bo);
+	if (!src || !dst)
+		return FALSE;
+
+	/* only the rows of the damage need cache maintenance */
+	pBox = RegionExtents(pRegion);
+	omap_bo_box_range(bo, pBox->x1 - crtc->x, pBox->y1 - crtc->y,
+			pBox->x2 - crtc->x, pBox->y2 - crtc->y, &range);
+	if (src_bo)
+		omap_bo_box_range(src_bo, pBox->x1, pBox->y1,
+				pBox->x2, pBox->y2, &src_range);
+
+	// acquire for write first, as in drmmode_copy_bo()
+	if (omap_bo_cpu_prep_range(bo, OMAP_GEM_WRITE, &range))
+		return FALSE;
+	if (src_bo && omap_bo_cpu_prep_range(src_bo, OMAP_GEM_READ,
+			&src_range)) {
+		omap_bo_cpu_fini(bo, 0);
+		return FALSE;
+	}
+
+	if (tiles) {
+		omap_crc_tiles_copy(tiles, dst, omap_bo_pitch(bo), src,
+				src_pitch, omap_bo_Bpp(bo), crtc->x, crtc->y,
+				pRegion);
+	} else {
+		pBox = RegionRects(pRegion);
+		for (i = 0; i < n; i++)
+			drmmode_copy_box(src, src_pitch, dst,
+					omap_bo_pitch(bo), omap_bo_Bpp(bo),
+					&pBox[i], crtc->x, crtc->y);
+	}
+
+	if (src_bo)
+		omap_bo_cpu_fini(src_bo, 0);
+	omap_bo_cpu_fini(bo, 0);
+
+	RegionEmpty(pRegion);
+	return TRUE;
+}
+
+/*
+ * (Re)allocate the TearFree bos of @crtc to match its mode, and fill the
+ * one about to be scanned out from the root scanout.
+ */
+static Bool drmmode_tearfree_init(ScrnInfoPtr pScrn, xf86CrtcPtr crtc)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	BoxRec box;
+	int i;
+
+	while (drmmode_crtc->tearfree_flip_pending)
+		drmmode_wait_for_event(pScrn);
+
+	drmmode_crtc_box(crtc, &box);
+	for (i = 0; i < 2; i++) {
+		struct omap_bo *bo = drmmode_crtc->tearfree_bo[i];
+
+		if (!bo || omap_bo_width(bo) != crtc->mode.HDisplay ||
+		    omap_bo_height(bo) != crtc->mode.VDisplay ||
+		    omap_bo_bpp(bo) != pScrn->bitsPerPixel) {
+			omap_bo_unreference(bo);
+			drmmode_crtc->tearfree_bo[i] = omap_bo_new_with_depth(
+					pOMAP->dev, crtc->mode.HDisplay,
+					crtc->mode.VDisplay, pScrn->depth,
+					pScrn->bitsPerPixel);
+			if (!drmmode_crtc->tearfree_bo[i]) {
+				ERROR_MSG("[CRTC:%u] TearFree buffer allocation failed",
+						drmmode_crtc_id(crtc));
+				drmmode_tearfree_fini(crtc);
+				return FALSE;
+			}
+		}
+		/* Whatever the bos held before is stale now. */
+		RegionReset(&drmmode_crtc->tearfree_damage[i], &box);
+	}
+
+	drmmode_crtc->tearfree_front = 0;
+	if (!drmmode_tearfree_copy(pScrn, crtc, 0)) {
+		drmmode_tearfree_fini(crtc);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void drmmode_tearfree_flip_complete(xf86CrtcPtr crtc)
+{
+	OMAPPtr pOMAP = OMAPPTR(crtc->scrn);
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+	drmmode_crtc->tearfree_flip_pending = FALSE;
+	pOMAP->pending_flips--;
+}
+
+/*
+ * Whether drmmode_tearfree_update() has an update to flip on @crtc, with
+ * the root scanout @damaged or not since its last call.
+ */
+static Bool drmmode_tearfree_wanted(xf86CrtcPtr crtc, Bool damaged)
+{
+	OMAPPtr pOMAP = OMAPPTR(crtc->scrn);
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+	if (pOMAP->flip_mode != OMAP_FLIP_DISABLED ||
+			!drmmode_crtc->tearfree_bo[0])
+		return FALSE;
+	return damaged || RegionNotEmpty(
+			&drmmode_crtc->tearfree_damage[!drmmode_crtc->tearfree_front]);
+}
+
+/*
+ * Update the TearFree bos of every crtc in blit mode with the root scanout
+ * @damage, and flip to them.  A crtc that still has a flip or a writeback
+ * capture pending just accumulates the damage; it is picked up by the next
+ * call after the flip event or the capture's fence has been handled.
+ */
+void drmmode_tearfree_update(ScrnInfoPtr pScrn, RegionPtr damage)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int i, j;
+
+	/* In flip mode the root scanout isn't displayed, and the TearFree
+	 * bos are refilled completely when returning to blit mode.
+	 */
+	if (pOMAP->flip_mode != OMAP_FLIP_DISABLED)
+		return;
+
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+		drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+		uint32_t crtc_id = drmmode_crtc_id(crtc);
+		RegionRec crtc_damage;
+		BoxRec box;
+		uint32_t fb_id;
+		int back;
+
+		if (!crtc->enabled || !drmmode_crtc->tearfree_bo[0])
+			continue;
+
+		drmmode_crtc_box(crtc, &box);
+		RegionInit(&crtc_damage, &box, 1);
+		RegionIntersect(&crtc_damage, &crtc_damage, damage);
+		for (j = 0; j < 2; j++)
+			RegionUnion(&drmmode_crtc->tearfree_damage[j],
+					&drmmode_crtc->tearfree_damage[j],
+					&crtc_damage);
+		RegionUninit(&crtc_damage);
+
+		if (drmmode_crtc->tearfree_flip_pending ||
+				drmmode_writeback_busy(crtc))
+			continue;
+
+		back = !drmmode_crtc->tearfree_front;
+		if (!RegionNotEmpty(&drmmode_crtc->tearfree_damage[back]))
+			continue;
+
+		if (!drmmode_tearfree_copy(pScrn, crtc, back)) {
+			ERROR_MSG("[CRTC:%u] TearFree update failed", crtc_id);
+			continue;
+		}
+
+		fb_id = omap_bo_fb(drmmode_crtc->tearfree_bo[back]);
+		if (drmModePageFlip(pOMAP->drmFD, crtc_id, fb_id,
+				DRM_MODE_PAGE_FLIP_EVENT,
+				(void *)((uintptr_t)crtc | DRMMODE_TEARFREE_FLIP))) {
+			ERROR_MSG("[CRTC:%u] [FB:%u] TearFree flip failed: %s",
+					crtc_id, fb_id, strerror(errno));
+			/* have the whole back bo copied again next time */
+			RegionReset(&drmmode_crtc->tearfree_damage[back], &box);
+			continue;
+		}
+
+		drmmode_crtc->tearfree_front = back;
+		drmmode_crtc->tearfree_flip_pending = TRUE;
+		pOMAP->pending_flips++;
+	}
+}
+
+/*
+ * Set @crtc to display the root scanout, through its TearFree bos if
+ * TearFree is enabled.
+ */
+static Bool drmmode_set_root_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc)
 {
 	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+	if (pOMAP->tear_free && drmmode_tearfree_init(pScrn, crtc))
+		return drmmode_set_crtc(pScrn, crtc,
+				drmmode_crtc->tearfree_bo[drmmode_crtc->tearfree_front],
+				0, 0);
+
+	return drmmode_set_crtc(pScrn, crtc, pOMAP->scanout, crtc->x, crtc->y);
+}
+
+static Bool drmmode_set_blit_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc)
+{
 	Bool ret;
 
 	if (!crtc->enabled)
 		return TRUE;
 
-	ret = drmmode_set_crtc(pScrn, crtc, pOMAP->scanout, crtc->x, crtc->y);
+	ret = drmmode_set_root_crtc(pScrn, crtc);
 	if (!ret) {
 		ERROR_MSG("[CRTC:%u] set root scanout failed",
 				drmmode_crtc_id(crtc));
@@ -530,10 +1135,50 @@ static Bool drmmode_set_flip_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc)
 	return ret;
 }
 
+static Bool drmmode_set_span_crtc(ScrnInfoPtr pScrn, xf86CrtcPtr crtc)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	OMAPScanoutPtr scanout;
+	Bool ret;
+
+	if (!crtc->enabled)
+		return TRUE;
+
+	scanout = drmmode_span_scanout(pOMAP->scanouts);
+	if (!scanout)
+		return TRUE;
+
+	ret = drmmode_set_crtc(pScrn, crtc, scanout->bo,
+			crtc->x - scanout->x, crtc->y - scanout->y);
+	if (!ret) {
+		ERROR_MSG("[CRTC:%u] set span scanout failed",
+				drmmode_crtc_id(crtc));
+		drmmode_set_crtc_off(crtc);
+	}
+
+	return ret;
+}
+
+static Bool
+drmmode_scanouts_overlap(OMAPScanoutPtr a, OMAPScanoutPtr b)
+{
+	return a->x < b->x + b->width && b->x < a->x + a->width &&
+			a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+/*
+ * Bring the root bo up to date with the per-crtc bos.
+ *
+ * Only scanouts that changed since they were last copied into the root bo
+ * (flipped to a new bo, or newly validated) are copied again, so repeated
+ * reads of the root pixmap in flip mode are free.  Cloned crtcs may overlap;
+ * a later scanout overlapping a stale one is copied as well so that it still
+ * wins, as it would with a full update.
+ */
 Bool drmmode_update_scanout_from_crtcs(ScrnInfoPtr pScrn)
 {
 	OMAPPtr pOMAP = OMAPPTR(pScrn);
-	int i;
+	int i, j;
 	Bool res;
 
 	if (pOMAP->flip_mode == OMAP_FLIP_DISABLED)
@@ -541,13 +1186,27 @@ Bool drmmode_update_scanout_from_crtcs(ScrnInfoPtr pScrn)
 
 	TRACE_ENTER();
 
-	/* Only copy if source is valid. */
+	for (i = 0; i < MAX_SCANOUTS; i++) {
+		OMAPScanoutPtr scanout = &pOMAP->scanouts[i];
+
+		if (!scanout->bo || !scanout->valid || scanout->in_root)
+			continue;
+
+		for (j = i + 1; j < MAX_SCANOUTS; j++) {
+			OMAPScanoutPtr other = &pOMAP->scanouts[j];
+
+			if (other->bo && drmmode_scanouts_overlap(scanout, other))
+				other->in_root = FALSE;
+		}
+	}
+
+	/* Only copy if source is valid and has changed. */
 	for (i = 0; i < MAX_SCANOUTS; i++) {
 		OMAPScanoutPtr scanout = &pOMAP->scanouts[i];
 
 		if (!scanout->bo)
 			continue;
-		if (!scanout->valid)
+		if (!scanout->valid || scanout->in_root)
 			continue;
 
 		res = drmmode_copy_bo(pScrn, scanout->bo, scanout->x,
@@ -556,6 +1215,7 @@ Bool drmmode_update_scanout_from_crtcs(ScrnInfoPtr pScrn)
 			ERROR_MSG("Copy crtc to scanout failed");
 			goto out;
 		}
+		scanout->in_root = TRUE;
 	}
 	res = TRUE;
 out:
@@ -563,11 +1223,88 @@ out:
 	return res;
 }
 
+/*
+ * Read the rectangle (@x, @y, @w, @h) of the root window straight from the
+ * per-crtc bos being scanned out, as for GetImage of the root window in flip
+ * mode.  Neither the flip state nor the root bo are touched.  Returns FALSE,
+ * having read nothing useful, unless the rectangle is covered by valid
+ * scanouts that do not overlap each other.
+ */
+Bool drmmode_read_scanouts(ScrnInfoPtr pScrn, int x, int y, int w, int h,
+		uint8_t *dst, int dst_pitch)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	OMAPScanoutPtr hit[MAX_SCANOUTS];
+	BoxRec boxes[MAX_SCANOUTS];
+	long area = 0;
+	int i, j, n = 0;
+
+	if (pOMAP->flip_mode == OMAP_FLIP_DISABLED)
+		return FALSE;
+
+	for (i = 0; i < MAX_SCANOUTS; i++) {
+		OMAPScanoutPtr scanout = &pOMAP->scanouts[i];
+		BoxRec box;
+
+		if (!scanout->bo || !scanout->valid)
+			continue;
+
+		box.x1 = max(x, scanout->x);
+		box.y1 = max(y, scanout->y);
+		box.x2 = min(x + w, scanout->x + scanout->width);
+		box.y2 = min(y + h, scanout->y + scanout->height);
+		if (box.x1 >= box.x2 || box.y1 >= box.y2)
+			continue;
+
+		/* cloned crtcs: leave it to the root bo which one wins */
+		for (j = 0; j < n; j++)
+			if (drmmode_scanouts_overlap(scanout, hit[j]))
+				return FALSE;
+
+		hit[n] = scanout;
+		boxes[n++] = box;
+		area += (long)(box.x2 - box.x1) * (box.y2 - box.y1);
+	}
+	if (!n || area != (long)w * h)
+		return FALSE;
+
+	for (i = 0; i < n; i++) {
+		OMAPScanoutPtr scanout = hit[i];
+		BoxPtr box = &boxes[i];
+		int cpp = omap_bo_bpp(scanout->bo) / 8;
+		int pitch = omap_bo_pitch(scanout->bo);
+		struct omap_bo_range range;
+		const uint8_t *src;
+
+		src = omap_bo_map(scanout->bo);
+		if (!src)
+			return FALSE;
+
+		/* hold off the GPU while the displayed frame is read */
+		OMAPEXAWaitBo(pScrn, scanout->bo);
+		omap_bo_box_range(scanout->bo, box->x1 - scanout->x,
+				box->y1 - scanout->y, box->x2 - scanout->x,
+				box->y2 - scanout->y, &range);
+		if (omap_bo_cpu_prep_range(scanout->bo, OMAP_GEM_READ, &range))
+			return FALSE;
+
+		omap_fetch_rect(dst + (box->y1 - y) * dst_pitch +
+				(box->x1 - x) * cpp, dst_pitch,
+				src + (box->y1 - scanout->y) * pitch +
+				(box->x1 - scanout->x) * cpp, pitch,
+				(box->x2 - box->x1) * cpp, box->y2 - box->y1);
+
+		omap_bo_cpu_fini(scanout->bo, OMAP_GEM_READ);
+	}
+
+	return TRUE;
+}
+
 /*
  * Enter blit mode.
  *
  * First, wait for all pending flips to complete.
- * Next, copy all valid per-crtc bo contents to the root bo, and mark their
+ * Next, bring the root bo up to date from the per-crtc bos, and mark their
  * scanouts as invalid to ensure they get updated when switching back to flip
  * mode.
  * Lastly, set all enabled crtcs to scan out from the root bo.
@@ -586,22 +1323,13 @@ Bool drmmode_set_blit_mode(ScrnInfoPtr pScrn)
 	while (pOMAP->pending_flips > 0)
 		drmmode_wait_for_event(pScrn);
 
-	/* Only copy if source is valid. */
-	for (i = 0; i < MAX_SCANOUTS; i++) {
-		OMAPScanoutPtr scanout = &pOMAP->scanouts[i];
-
-		if (!scanout->bo)
-			continue;
-		if (!scanout->valid)
-			continue;
+	if (!drmmode_update_scanout_from_crtcs(pScrn))
+		return FALSE;
 
-		ret = drmmode_copy_bo(pScrn, scanout->bo, scanout->x,
-					  scanout->y, pOMAP->scanout, 0, 0);
-		if (!ret) {
-			ERROR_MSG("Copy crtc to scanout failed");
-			return FALSE;
-		}
-		scanout->valid = FALSE;
+	/* the root bo gets rendered to from now on */
+	for (i = 0; i < MAX_SCANOUTS; i++) {
+		pOMAP->scanouts[i].valid = FALSE;
+		pOMAP->scanouts[i].in_root = FALSE;
 	}
 	for (i = 0; i < xf86_config->num_crtc; i++) {
 		xf86CrtcPtr crtc = xf86_config->crtc[i];
@@ -618,7 +1346,11 @@ unwind:
 	/* try restoring already transitioned CRTCs back to flip mode */
 	while (--i >= 0) {
 		xf86CrtcPtr crtc = xf86_config->crtc[i];
-		if (!drmmode_set_flip_crtc(pScrn, crtc))
+		if (pOMAP->flip_mode == OMAP_FLIP_SPAN)
+			ret = drmmode_set_span_crtc(pScrn, crtc);
+		else
+			ret = drmmode_set_flip_crtc(pScrn, crtc);
+		if (!ret)
 			ERROR_MSG("[CRTC:%u] could not restore flip mode",
 					drmmode_crtc_id(crtc));
 	}
@@ -628,7 +1360,9 @@ unwind:
 /*
  * Enter flip mode.
  *
- * First, copy contents from the root bo to each invalid per-crtc bo, and mark
+ * When coming from span mode, go through blit mode so that the root bo is up
+ * to date.
+ * Then copy contents from the root bo to each invalid per-crtc bo, and mark
  * its scanout as valid.
  * Lastly, set all enabled crtcs to scan out from their per-crtc bos.
  */
@@ -642,11 +1376,18 @@ Bool drmmode_set_flip_mode(ScrnInfoPtr pScrn)
 	if (pOMAP->flip_mode == OMAP_FLIP_ENABLED)
 		return TRUE;
 
+	if (pOMAP->flip_mode == OMAP_FLIP_SPAN && !drmmode_set_blit_mode(pScrn))
+		return FALSE;
+
+	/* TearFree flips must land before the crtcs are switched away */
+	while (pOMAP->pending_flips > 0)
+		drmmode_wait_for_event(pScrn);
+
 	/* Only copy if destination is invalid. */
 	for (i = 0; i < MAX_SCANOUTS; i++) {
 		OMAPScanoutPtr scanout = &pOMAP->scanouts[i];
 
-		if (!scanout->bo)
+		if (!scanout->bo || scanout->span)
 			continue;
 		if (scanout->valid)
 			continue;
@@ -659,6 +1400,7 @@ Bool drmmode_set_flip_mode(ScrnInfoPtr pScrn)
 			return FALSE;
 		}
 		scanout->valid = TRUE;
+		scanout->in_root = TRUE;
 	}
 
 	for (i = 0; i < xf86_config->num_crtc; i++) {
@@ -683,6 +1425,73 @@ unwind:
 	return FALSE;
 }
 
+/*
+ * Enter span mode.
+ *
+ * Like flip mode, but all enabled crtcs scan out their own part of the span
+ * bo, so a drawable covering several monitors can be flipped as a whole.
+ * Per-crtc flip mode is left through blit mode first, so only the span
+ * scanout is valid afterwards.
+ */
+Bool drmmode_set_span_mode(ScrnInfoPtr pScrn)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	OMAPScanoutPtr scanout;
+	int i;
+	Bool ret;
+
+	if (pOMAP->flip_mode == OMAP_FLIP_SPAN)
+		return TRUE;
+
+	scanout = drmmode_span_scanout(pOMAP->scanouts);
+	if (!scanout)
+		return FALSE;
+
+	if (pOMAP->flip_mode == OMAP_FLIP_ENABLED &&
+			!drmmode_set_blit_mode(pScrn))
+		return FALSE;
+
+	/* TearFree flips must land before the crtcs are switched away */
+	while (pOMAP->pending_flips > 0)
+		drmmode_wait_for_event(pScrn);
+
+	if (!scanout->valid) {
+		ret = drmmode_copy_bo(pScrn, pOMAP->scanout, 0, 0,
+					  scanout->bo, scanout->x,
+					  scanout->y);
+		if (!ret) {
+			ERROR_MSG("Copy scanout to span failed");
+			return FALSE;
+		}
+		scanout->valid = TRUE;
+		scanout->in_root = TRUE;
+	}
+
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+		if (!drmmode_set_span_crtc(pScrn, crtc)) {
+			ERROR_MSG("[CRTC:%u] could not set span mode",
+					drmmode_crtc_id(crtc));
+			goto unwind;
+		}
+	}
+	pOMAP->flip_mode = OMAP_FLIP_SPAN;
+	return TRUE;
+
+unwind:
+	/* rendering goes to the root bo again, so the copy will go stale */
+	scanout->valid = FALSE;
+	/* try restoring already transitioned CRTCs back to blit mode */
+	while (--i >= 0) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+		if (!drmmode_set_blit_crtc(pScrn, crtc))
+			ERROR_MSG("[CRTC:%u] could not restore blit mode",
+					drmmode_crtc_id(crtc));
+	}
+	return FALSE;
+}
+
 static Bool drmmode_update_scanouts(ScrnInfoPtr pScrn)
 {
 	OMAPPtr pOMAP = OMAPPTR(pScrn);
@@ -771,7 +1580,7 @@ drmmode_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode,
 	// On a modeset, we should switch to blit mode to get a single scanout buffer
 	// and we will switch back to flip mode on the next flip request
 	if (pOMAP->flip_mode == OMAP_FLIP_DISABLED)
-		ret = drmmode_set_crtc(pScrn, crtc, pOMAP->scanout, crtc->x, crtc->y);
+		ret = drmmode_set_root_crtc(pScrn, crtc);
 	else
 		ret = drmmode_set_blit_mode(pScrn);
 	if (!ret)
@@ -812,16 +1621,64 @@ done:
 	return ret;
 }
 
-#define CURSORW  64
-#define CURSORH  64
+/* How long the crtc takes to scan out a frame, in ms */
+static CARD32
+drmmode_frame_time(xf86CrtcPtr crtc)
+{
+	DisplayModePtr mode = &crtc->mode;
+
+	/* Clock is in kHz */
+	if (!mode->Clock || !mode->HTotal || !mode->VTotal)
+		return 16;
+	return (CARD32)mode->HTotal * mode->VTotal / mode->Clock;
+}
 
 static void
-drmmode_set_cursor_position(xf86CrtcPtr crtc, int x, int y)
+drmmode_move_cursor(xf86CrtcPtr crtc)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	drmmode_ptr drmmode = drmmode_crtc->drmmode;
 
-	drmModeMoveCursor(drmmode->fd, drmmode_crtc_id(crtc), x, y);
+	if (!drmmode_crtc->cursor_moved)
+		return;
+
+	drmmode_crtc->cursor_moved = FALSE;
+	drmmode_crtc->cursor_move_time = GetTimeInMillis();
+	drmModeMoveCursor(drmmode->fd, drmmode_crtc_id(crtc),
+			drmmode_crtc->cursor_x, drmmode_crtc->cursor_y);
+}
+
+/*
+ * Moves go to the kernel at most once a frame: one within a frame of the
+ * last only notes the position, and the block handler passes on the last
+ * of those, unless a later move has done so already.
+ */
+static void
+drmmode_set_cursor_position(xf86CrtcPtr crtc, int x, int y)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+	drmmode_crtc->cursor_x = x;
+	drmmode_crtc->cursor_y = y;
+	drmmode_crtc->cursor_moved = TRUE;
+
+	if (GetTimeInMillis() - drmmode_crtc->cursor_move_time >=
+			drmmode_frame_time(crtc))
+		drmmode_move_cursor(crtc);
+}
+
+/* Apply the cursor moves held back by drmmode_set_cursor_position() */
+void
+drmmode_cursor_flush(ScrnInfoPtr pScrn)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	int i;
+
+	/* moves may come from the input thread, or a SIGIO handler */
+	input_lock();
+	for (i = 0; i < xf86_config->num_crtc; i++)
+		drmmode_move_cursor(xf86_config->crtc[i]);
+	input_unlock();
 }
 
 static void
@@ -830,7 +1687,9 @@ drmmode_hide_cursor(xf86CrtcPtr crtc)
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	drmmode_ptr drmmode = drmmode_crtc->drmmode;
 
-	drmModeSetCursor(drmmode->fd, drmmode_crtc_id(crtc), 0, CURSORW, CURSORH);
+	drmmode_crtc->cursor_shown = FALSE;
+	drmModeSetCursor(drmmode->fd, drmmode_crtc_id(crtc), 0,
+			drmmode->cursor_width, drmmode->cursor_height);
 }
 
 static void
@@ -838,33 +1697,65 @@ drmmode_show_cursor(xf86CrtcPtr crtc)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	drmmode_ptr drmmode = drmmode_crtc->drmmode;
-	struct omap_bo* cursor_bo = drmmode_crtc->cursor_bo;
-	uint32_t handle = cursor_bo ? omap_bo_handle(cursor_bo) : 0;
-	drmModeSetCursor(drmmode->fd, drmmode_crtc_id(crtc), handle, CURSORW, CURSORH);
+	struct omap_bo *cursor_bo =
+			drmmode_crtc->cursor_bo[drmmode_crtc->cursor_front];
+
+	/* don't show it where it was before */
+	drmmode_move_cursor(crtc);
+	drmmode_crtc->cursor_shown = TRUE;
+	drmModeSetCursor(drmmode->fd, drmmode_crtc_id(crtc),
+			omap_bo_handle(cursor_bo), drmmode->cursor_width,
+			drmmode->cursor_height);
+}
+
+/* FNV-1a, over whole pixels */
+static uint64_t
+drmmode_cursor_hash(const CARD32 *image, int n)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		hash ^= image[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
 }
 
 static void
 drmmode_load_cursor_argb(xf86CrtcPtr crtc, CARD32 *image)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
-	struct omap_bo* cursor_bo = drmmode_crtc->cursor_bo;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	int w = drmmode->cursor_width, h = drmmode->cursor_height;
+	uint64_t hash = drmmode_cursor_hash(image, w * h);
+	int front = drmmode_crtc->cursor_front, back = !front;
+	struct omap_bo *cursor_bo = drmmode_crtc->cursor_bo[back];
+	uint8_t *dst;
 	int row;
-	void* dst;
-	const char* src_row;
-	char* dst_row;
 
-	if (!cursor_bo)
+	if (drmmode_crtc->cursor_loaded[front] &&
+			drmmode_crtc->cursor_hash[front] == hash)
 		return;
 
-	dst = omap_bo_map(cursor_bo);
-	omap_bo_cpu_prep(cursor_bo, OMAP_GEM_WRITE);
-	for (row = 0; row < CURSORH; row += 1) {
-		// we're operating with ARGB data (32bpp)
-		src_row = (const char*)image + row * 4 * CURSORW;
-		dst_row = (char*)dst + row * 4 * CURSORW;
-		memcpy(dst_row, src_row, 4 * CURSORW);
-	}
-	omap_bo_cpu_fini(cursor_bo, 0);
+	/* Animated cursors often go back to the previous frame */
+	if (!drmmode_crtc->cursor_loaded[back] ||
+			drmmode_crtc->cursor_hash[back] != hash) {
+		dst = omap_bo_map(cursor_bo);
+		if (!dst || omap_bo_cpu_prep(cursor_bo, OMAP_GEM_WRITE))
+			return;
+		for (row = 0; row < h; row++)
+			memcpy(dst + row * omap_bo_pitch(cursor_bo),
+					image + row * w, 4 * w);
+		omap_bo_cpu_fini(cursor_bo, OMAP_GEM_WRITE);
+		drmmode_crtc->cursor_hash[back] = hash;
+		drmmode_crtc->cursor_loaded[back] = TRUE;
+	}
+
+	drmmode_crtc->cursor_front = back;
+	if (drmmode_crtc->cursor_shown)
+		drmModeSetCursor(drmmode->fd, drmmode_crtc_id(crtc),
+				omap_bo_handle(cursor_bo), w, h);
 }
 
 #ifdef OMAP_SUPPORT_GAMMA
@@ -890,7 +1781,9 @@ drmmode_crtc_destroy(xf86CrtcPtr crtc)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 
-	omap_bo_unreference(drmmode_crtc->cursor_bo);
+	omap_bo_unreference(drmmode_crtc->cursor_bo[0]);
+	omap_bo_unreference(drmmode_crtc->cursor_bo[1]);
+	drmmode_tearfree_fini(crtc);
 	free(drmmode_crtc);
 	crtc->driver_private = NULL;
 }
@@ -919,6 +1812,7 @@ drmmode_crtc_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
 	Bool ret;
 	uint32_t crtc_id = mode_res->crtcs[num];
 	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	int i;
 
 	TRACE_ENTER();
 
@@ -931,12 +1825,17 @@ drmmode_crtc_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
 	}
 	drmmode_crtc->id = crtc_id;
 	drmmode_crtc->drmmode = drmmode;
-	drmmode_crtc->cursor_bo = omap_bo_new_with_format(pOMAP->dev, CURSORW, CURSORH,
-			DRM_FORMAT_ARGB8888, 32);
-	if (!drmmode_crtc->cursor_bo) {
-		ERROR_MSG("error allocating hw cursor buffer");
-		ret = FALSE;
-		goto err_free_drmmode_crtc;
+	RegionNull(&drmmode_crtc->tearfree_damage[0]);
+	RegionNull(&drmmode_crtc->tearfree_damage[1]);
+	for (i = 0; i < 2; i++) {
+		drmmode_crtc->cursor_bo[i] = omap_bo_new_with_format(pOMAP->dev,
+				drmmode->cursor_width, drmmode->cursor_height,
+				DRM_FORMAT_ARGB8888, 32);
+		if (!drmmode_crtc->cursor_bo[i]) {
+			ERROR_MSG("error allocating hw cursor buffer");
+			ret = FALSE;
+			goto err_destroy_cursor;
+		}
 	}
 
 	crtc = xf86CrtcCreate(pScrn, &drmmode_crtc_funcs);
@@ -946,9 +1845,10 @@ drmmode_crtc_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
 		goto err_destroy_cursor;
 	}
 
-	INFO_MSG("[CRTC:%u] HW Cursor using [BO:%u]",
+	INFO_MSG("[CRTC:%u] HW Cursor using [BO:%u] and [BO:%u]",
 			drmmode_crtc->id,
-			omap_bo_handle(drmmode_crtc->cursor_bo));
+			omap_bo_handle(drmmode_crtc->cursor_bo[0]),
+			omap_bo_handle(drmmode_crtc->cursor_bo[1]));
 
 	crtc->driver_private = drmmode_crtc;
 
@@ -956,8 +1856,8 @@ drmmode_crtc_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
 	goto out;
 
 err_destroy_cursor:
-	omap_bo_unreference(drmmode_crtc->cursor_bo);
-err_free_drmmode_crtc:
+	omap_bo_unreference(drmmode_crtc->cursor_bo[0]);
+	omap_bo_unreference(drmmode_crtc->cursor_bo[1]);
 	free(drmmode_crtc);
 out:
 	TRACE_EXIT();
@@ -1411,6 +2311,326 @@ static const xf86OutputFuncsRec drmmode_output_funcs = {
 		.destroy = drmmode_output_destroy
 };
 
+/*
+ * Writeback
+ *
+ * With Option "Writeback", each writeback connector has the display engine
+ * write what one crtc displays into a ring of bos, so the CPU never reads a
+ * scanout.  Whenever the screen changed since the last frame, the next one is
+ * captured, with at most one in flight.  Once a frame is complete, it is
+ * published on the root window in the _ARMSOC_WRITEBACK<n> property, as the
+ * CARD32s
+ *   sequence, crtc id, width, height, pitch, fourcc, flink name
+ * from which a recorder can open the bo and export it as a dma-buf.
+ */
+
+static Bool
+drmmode_writeback_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
+		drmModeConnectorPtr koutput)
+{
+	drmmode_writeback_ptr wb;
+	drmModeEncoderPtr kencoder;
+	drmModePropertyBlobPtr blob = NULL;
+	uint32_t connector_id = koutput->connector_id;
+	Bool has_format = FALSE;
+	int i;
+
+	for (i = 0; i < koutput->count_props; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(drmmode->fd,
+				koutput->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, "WRITEBACK_PIXEL_FORMATS"))
+			blob = drmModeGetPropertyBlob(drmmode->fd,
+					koutput->prop_values[i]);
+		drmModeFreeProperty(prop);
+	}
+	if (blob) {
+		const uint32_t *formats = blob->data;
+		uint32_t j;
+
+		for (j = 0; j < blob->length / sizeof(*formats); j++)
+			if (formats[j] == DRM_FORMAT_XRGB8888)
+				has_format = TRUE;
+		drmModeFreePropertyBlob(blob);
+	}
+	if (!has_format) {
+		WARNING_MSG("[CONNECTOR:%u] writeback without XRGB8888 ignored",
+				connector_id);
+		return TRUE;
+	}
+
+	if (!koutput->count_encoders)
+		return TRUE;
+	kencoder = drmModeGetEncoder(drmmode->fd, koutput->encoders[0]);
+	if (!kencoder) {
+		ERROR_MSG("[CONNECTOR:%u] Failed drmModeGetEncoder",
+				connector_id);
+		return FALSE;
+	}
+
+	wb = realloc(drmmode->writeback,
+			(drmmode->num_writeback + 1) * sizeof(*wb));
+	if (!wb) {
+		drmModeFreeEncoder(kencoder);
+		return FALSE;
+	}
+	drmmode->writeback = wb;
+	wb += drmmode->num_writeback;
+
+	memset(wb, 0, sizeof(*wb));
+	wb->pScrn = pScrn;
+	wb->id = connector_id;
+	wb->possible_crtcs = kencoder->possible_crtcs;
+	wb->crtc_id_prop = drmmode_get_prop_id(drmmode->fd,
+			koutput->count_props, koutput->props, "CRTC_ID", 0);
+	wb->fb_id_prop = drmmode_get_prop_id(drmmode->fd,
+			koutput->count_props, koutput->props,
+			"WRITEBACK_FB_ID", 0);
+	wb->out_fence_prop = drmmode_get_prop_id(drmmode->fd,
+			koutput->count_props, koutput->props,
+			"WRITEBACK_OUT_FENCE_PTR", 0);
+	wb->latest = -1;
+	wb->pending = -1;
+	wb->fence = -1;
+	wb->dirty = TRUE;
+	drmModeFreeEncoder(kencoder);
+
+	if (!wb->crtc_id_prop || !wb->fb_id_prop || !wb->out_fence_prop) {
+		WARNING_MSG("[CONNECTOR:%u] writeback properties missing",
+				connector_id);
+		return TRUE;
+	}
+
+	INFO_MSG("[CONNECTOR:%u] Writeback capture %d",
+			connector_id, drmmode->num_writeback);
+	drmmode->num_writeback++;
+	return TRUE;
+}
+
+static void
+drmmode_writeback_free_bos(drmmode_writeback_ptr wb)
+{
+	int i;
+
+	for (i = 0; i < DRMMODE_WRITEBACK_BOS; i++) {
+		omap_bo_unreference(wb->bo[i]);
+		wb->bo[i] = NULL;
+	}
+	wb->latest = -1;
+}
+
+/* (Re)allocate the ring to the size of @crtc's mode */
+static Bool
+drmmode_writeback_bos(ScrnInfoPtr pScrn, drmmode_writeback_ptr wb,
+		xf86CrtcPtr crtc)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	int width = crtc->mode.HDisplay;
+	int height = crtc->mode.VDisplay;
+	int i;
+
+	if (wb->bo[DRMMODE_WRITEBACK_BOS - 1] &&
+			omap_bo_width(wb->bo[0]) == width &&
+			omap_bo_height(wb->bo[0]) == height)
+		return TRUE;
+
+	drmmode_writeback_free_bos(wb);
+	for (i = 0; i < DRMMODE_WRITEBACK_BOS; i++) {
+		wb->bo[i] = omap_bo_new_with_format(pOMAP->dev, width, height,
+				DRM_FORMAT_XRGB8888, 32);
+		if (!wb->bo[i]) {
+			ERROR_MSG("[CONNECTOR:%u] writeback buffer allocation failed",
+					wb->id);
+			drmmode_writeback_free_bos(wb);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+drmmode_writeback_publish(ScrnInfoPtr pScrn, drmmode_writeback_ptr wb)
+{
+	drmmode_ptr drmmode = drmmode_from_scrn(pScrn);
+	ScreenPtr pScreen = xf86ScrnToScreen(pScrn);
+	struct omap_bo *bo = wb->bo[wb->latest];
+	CARD32 frame[7];
+	char name[32];
+	Atom atom;
+
+	if (!pScreen || !pScreen->root)
+		return;
+
+	snprintf(name, sizeof(name), "_ARMSOC_WRITEBACK%d",
+			(int)(wb - drmmode->writeback));
+	atom = MakeAtom(name, strlen(name), TRUE);
+
+	frame[0] = wb->sequence;
+	frame[1] = drmmode_crtc_id(wb->crtc);
+	frame[2] = omap_bo_width(bo);
+	frame[3] = omap_bo_height(bo);
+	frame[4] = omap_bo_pitch(bo);
+	frame[5] = DRM_FORMAT_XRGB8888;
+	frame[6] = omap_bo_get_name(bo);
+	dixChangeWindowProperty(serverClient, pScreen->root, atom, XA_INTEGER,
+			32, PropModeReplace, ARRAY_SIZE(frame), frame, TRUE);
+}
+
+/*
+ * The fence of the pending frame signaled.  Input handlers must not be
+ * removed from their own callback, so that is left to the block handler.
+ */
+static void
+drmmode_writeback_signaled(int fd, void *closure)
+{
+	drmmode_writeback_ptr wb = closure;
+
+	xf86DisableGeneralHandler(wb->fence_handler);
+	wb->fence_signaled = TRUE;
+}
+
+static void
+drmmode_writeback_reap(ScrnInfoPtr pScrn, drmmode_writeback_ptr wb)
+{
+	if (wb->fence_handler)
+		xf86RemoveGeneralHandler(wb->fence_handler);
+	wb->fence_handler = NULL;
+	close(wb->fence);
+	wb->fence = -1;
+
+	wb->latest = wb->pending;
+	wb->pending = -1;
+	wb->sequence++;
+	drmmode_writeback_publish(pScrn, wb);
+}
+
+static void
+drmmode_writeback_commit(ScrnInfoPtr pScrn, drmmode_writeback_ptr wb)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	drmmode_ptr drmmode = drmmode_from_scrn(pScrn);
+	xf86CrtcPtr crtc = drmmode_writeback_crtc(pScrn, wb);
+	drmModeAtomicReqPtr req;
+	struct pollfd pfd;
+	int slot, ret;
+
+	/* Attaching takes a modeset, so that is left to the next one of
+	 * @crtc, rather than allowed here.
+	 */
+	if (!crtc || crtc != wb->crtc || !wb->attached)
+		return;
+	/* Flips fail while the nonblocking commit is pending, and the
+	 * commit fails while they are: only capture between flips.
+	 */
+	if (pOMAP->pending_flips)
+		return;
+	if (!drmmode_writeback_bos(pScrn, wb, crtc))
+		return;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return;
+
+	slot = (wb->latest + 1) % DRMMODE_WRITEBACK_BOS;
+	drmModeAtomicAddProperty(req, wb->id, wb->fb_id_prop,
+			omap_bo_fb(wb->bo[slot]));
+	drmModeAtomicAddProperty(req, wb->id, wb->out_fence_prop,
+			(uintptr_t)&wb->fence);
+
+	ret = drmModeAtomicCommit(drmmode->fd, req, DRM_MODE_ATOMIC_NONBLOCK,
+			NULL);
+	drmModeAtomicFree(req);
+	if (ret) {
+		/* another client's commit is still pending; try again later */
+		if (errno == EBUSY)
+			return;
+		ERROR_MSG("[CONNECTOR:%u] writeback to [CRTC:%u] failed: %s",
+				wb->id, drmmode_crtc_id(crtc), strerror(errno));
+		wb->failed = TRUE;
+		return;
+	}
+
+	wb->pending = slot;
+	wb->dirty = FALSE;
+	wb->fence_signaled = FALSE;
+	wb->fence_handler = xf86AddGeneralHandler(wb->fence,
+			drmmode_writeback_signaled, wb);
+	if (!wb->fence_handler) {
+		pfd.fd = wb->fence;
+		pfd.events = POLLIN;
+		while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+			;
+		drmmode_writeback_reap(pScrn, wb);
+	}
+}
+
+/*
+ * Called from the block handler, with @damaged set if the screen changed:
+ * publish the frame captured last, and start capturing the next one.
+ */
+void drmmode_writeback_update(ScrnInfoPtr pScrn, Bool damaged)
+{
+	drmmode_ptr drmmode = drmmode_from_scrn(pScrn);
+	int i;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (wb->failed)
+			continue;
+
+		wb->dirty = wb->dirty || damaged;
+		if (wb->pending >= 0 && wb->fence_signaled) {
+			drmmode_writeback_reap(pScrn, wb);
+			/* take turns with the TearFree flips it held back */
+			if (drmmode_tearfree_wanted(wb->crtc, damaged))
+				continue;
+		}
+		if (wb->pending < 0 && wb->dirty)
+			drmmode_writeback_commit(pScrn, wb);
+	}
+}
+
+static void
+drmmode_writeback_fini(ScrnInfoPtr pScrn)
+{
+	drmmode_ptr drmmode = drmmode_from_scrn(pScrn);
+	drmModeAtomicReqPtr req;
+	int i;
+
+	for (i = 0; i < drmmode->num_writeback; i++) {
+		drmmode_writeback_ptr wb = &drmmode->writeback[i];
+
+		if (wb->fence_handler)
+			xf86RemoveGeneralHandler(wb->fence_handler);
+		wb->fence_handler = NULL;
+		if (wb->fence >= 0)
+			close(wb->fence);
+		wb->fence = -1;
+		wb->pending = -1;
+
+		req = wb->attached ? drmModeAtomicAlloc() : NULL;
+		if (req) {
+			drmModeAtomicAddProperty(req, wb->id,
+					wb->crtc_id_prop, 0);
+			drmModeAtomicAddProperty(req, wb->id,
+					wb->fb_id_prop, 0);
+			if (drmModeAtomicCommit(drmmode->fd, req,
+					DRM_MODE_ATOMIC_ALLOW_MODESET, NULL))
+				WARNING_MSG("[CONNECTOR:%u] writeback detach failed: %s",
+						wb->id, strerror(errno));
+			drmModeAtomicFree(req);
+		}
+		wb->attached = FALSE;
+		wb->crtc = NULL;
+		/* start the next server generation with a capture */
+		wb->dirty = TRUE;
+		drmmode_writeback_free_bos(wb);
+	}
+}
+
 // FIXME - Eliminate the following values that aren't accurate for OMAP4:
 const char *output_names[] = { "None",
 		"VGA",
@@ -1454,6 +2674,11 @@ drmmode_output_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
 		goto out;
 	}
 
+	if (koutput->connector_type == DRM_MODE_CONNECTOR_WRITEBACK) {
+		ret = drmmode_writeback_pre_init(pScrn, drmmode, koutput);
+		goto err_free_drm_mode_connector;
+	}
+
 	/*
 	 * Fetch possible clones and crtcs from this connector's encoder.
 	 * We assume here that there is only one possible encoder for this
@@ -1528,7 +2753,9 @@ drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 	OMAPPtr pOMAP = OMAPPTR(pScrn);
 	ScreenPtr pScreen = pScrn->pScreen;
 	struct omap_bo *new_scanout;
+	void *new_shadow;
 	uint32_t pitch;
+	int i;
 
 	TRACE_ENTER();
 
@@ -1536,6 +2763,12 @@ drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 
 	DEBUG_MSG("Resize!  %dx%d", width, height);
 
+	/* the old scanout and shadow may still be in use for a flush, or by
+	 * queued 2-D operations
+	 */
+	OMAPShadowWait(pScrn);
+	OMAPEXAWaitBo(pScrn, pOMAP->scanout);
+
 	if (  (width != omap_bo_width(pOMAP->scanout))
 	      || (height != omap_bo_height(pOMAP->scanout))
 	      || (pScrn->bitsPerPixel != omap_bo_bpp(pOMAP->scanout)) ) {
@@ -1552,9 +2785,24 @@ drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 			return FALSE;
 		}
 
+		if (pOMAP->shadow_fb) {
+			new_shadow = malloc(omap_bo_pitch(new_scanout) * height);
+			if (!new_shadow) {
+				ERROR_MSG("Error reallocating shadow framebuffer");
+				omap_bo_unreference(new_scanout);
+				return FALSE;
+			}
+			free(pOMAP->shadow);
+			pOMAP->shadow = new_shadow;
+		}
+
 		pOMAP->has_resized = TRUE;
 		omap_bo_unreference(pOMAP->scanout);
 		pOMAP->scanout = new_scanout;
+
+		/* nothing has been copied into the new root bo yet */
+		for (i = 0; i < MAX_SCANOUTS; i++)
+			pOMAP->scanouts[i].in_root = FALSE;
 	}
 
 	pScrn->virtualX = width;
@@ -1567,6 +2815,7 @@ drmmode_xf86crtc_resize(ScrnInfoPtr pScrn, int width, int height)
 		pScreen->ModifyPixmapHeader(rootPixmap,
 				pScrn->virtualX, pScrn->virtualY,
 				pScrn->depth, pScrn->bitsPerPixel, pitch,
+				pOMAP->shadow_fb ? pOMAP->shadow :
 				omap_bo_map(pOMAP->scanout));
 	}
 
@@ -1612,9 +2861,11 @@ static void drmmode_outputs_destroy(ScrnInfoPtr pScrn)
 
 Bool drmmode_pre_init(ScrnInfoPtr pScrn, int fd)
 {
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
 	drmmode_ptr drmmode;
 	drmModeResPtr mode_res;
 	drmModePlaneResPtr plane_res;
+	uint64_t value;
 	int i;
 	Bool ret;
 
@@ -1624,6 +2875,16 @@ Bool drmmode_pre_init(ScrnInfoPtr pScrn, int fd)
 
 	xf86CrtcConfigInit(pScrn, &drmmode_xf86crtc_config_funcs);
 
+	/* writeback connectors are only listed to atomic clients asking */
+	if (pOMAP->writeback &&
+			(drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1) ||
+			 drmSetClientCap(fd, DRM_CLIENT_CAP_WRITEBACK_CONNECTORS,
+					1))) {
+		WARNING_MSG("Writeback connectors not supported: %s",
+				strerror(errno));
+		pOMAP->writeback = FALSE;
+	}
+
 	mode_res = drmModeGetResources(fd);
 	if (!mode_res) {
 		ret = FALSE;
@@ -1660,6 +2921,19 @@ Bool drmmode_pre_init(ScrnInfoPtr pScrn, int fd)
 	}
 	drmmode->fd = fd;
 
+	/*
+	 * Cursors up to the largest size the hardware takes stay on the hw
+	 * cursor, instead of being drawn into the root pixmap.
+	 */
+	drmmode->cursor_width = CURSORW;
+	drmmode->cursor_height = CURSORH;
+	if (!drmGetCap(fd, DRM_CAP_CURSOR_WIDTH, &value) && value)
+		drmmode->cursor_width = value;
+	if (!drmGetCap(fd, DRM_CAP_CURSOR_HEIGHT, &value) && value)
+		drmmode->cursor_height = value;
+	INFO_MSG("HW cursor size %dx%d", drmmode->cursor_width,
+			drmmode->cursor_height);
+
 	ret = TRUE;
 	for (i = 0; i < mode_res->count_crtcs && ret; i++)
 		ret = drmmode_crtc_pre_init(pScrn, drmmode, mode_res,
@@ -1725,7 +2999,13 @@ static void
 page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
 		unsigned int tv_usec, void *user_data)
 {
-	OMAPDRI2SwapComplete(user_data);
+	uintptr_t data = (uintptr_t)user_data;
+
+	if (data & DRMMODE_TEARFREE_FLIP)
+		drmmode_tearfree_flip_complete(
+				(xf86CrtcPtr)(data & ~DRMMODE_TEARFREE_FLIP));
+	else
+		OMAPDRI2SwapComplete(user_data);
 }
 
 static drmEventContext event_context = {
@@ -1748,7 +3028,11 @@ drmmode_page_flip(DrawablePtr draw, uint32_t fb_id, void *priv,
 	flags |= DRM_MODE_PAGE_FLIP_EVENT;
 #endif
 
-	/* Flip all crtc's that match this drawable's position and size */
+	/*
+	 * Flip all crtc's that match this drawable's position and size, or in
+	 * span mode all crtc's inside it; they keep the offsets they were set
+	 * to in drmmode_set_span_mode().
+	 */
 	*num_flipped = 0;
 	for (i = 0; i < xf86_config->num_crtc; i++) {
 		xf86CrtcPtr crtc = xf86_config->crtc[i];
@@ -1770,12 +3054,20 @@ drmmode_page_flip(DrawablePtr draw, uint32_t fb_id, void *priv,
 		if (!connected)
 			continue;
 
-		if (crtc->x != draw->x || crtc->y != draw->y ||
+		if (pOMAP->flip_mode == OMAP_FLIP_SPAN) {
+			if (crtc->x < draw->x || crtc->y < draw->y ||
+			    crtc->x + crtc->mode.HDisplay >
+					draw->x + draw->width ||
+			    crtc->y + crtc->mode.VDisplay >
+					draw->y + draw->height)
+				continue;
+		} else if (crtc->x != draw->x || crtc->y != draw->y ||
 		    crtc->mode.HDisplay != draw->width ||
 		    crtc->mode.VDisplay != draw->height)
 			continue;
 
 		DEBUG_MSG("[CRTC:%u] [FB:%u]", crtc_id, fb_id);
+		drmmode_writeback_wait(crtc);
 		ret = drmModePageFlip(pOMAP->drmFD, crtc_id, fb_id, flags,
 				priv);
 		if (ret) {
@@ -1933,7 +3225,8 @@ drmmode_screen_init(ScrnInfoPtr pScrn)
 	Bool ret;
 
 	/* Per ScreenInit cursor initialization */
-	ret = xf86_cursors_init(pScreen, CURSORW, CURSORH, HARDWARE_CURSOR_ARGB);
+	ret = xf86_cursors_init(pScreen, drmmode->cursor_width,
+			drmmode->cursor_height, HARDWARE_CURSOR_ARGB);
 	if (!ret) {
 		ERROR_MSG("xf86_cursors_init() failed");
 		goto out;
@@ -1971,6 +3264,7 @@ drmmode_close_screen(ScrnInfoPtr pScrn)
 	drmmode_ptr drmmode = drmmode_from_scrn(pScrn);
 	ScreenPtr pScreen = xf86ScrnToScreen(pScrn);
 
+	drmmode_writeback_fini(pScrn);
 	RemoveBlockAndWakeupHandlers((BlockHandlerProcPtr)NoopDDA,
 			drmmode_wakeup_handler, pScrn);
 	RemoveGeneralSocket(drmmode->fd);
@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_ACCEL_H_
+#define OMAP_ACCEL_H_
+
+#include <stdint.h>
+#include <xf86.h>
+
+/*
+ * Interface for 2D accelerator modules, e.g. driving a SoC's blitter.
+ *
+ * A module is an ordinary X server module, selected with the AccelModule
+ * option, which exports a struct omap_accel_ops named "<module>AccelOps".
+ * The driver offers it each EXA solid fill, copy and composite: the check
+ * hooks decide whether it takes an operation, which then goes to the
+ * operation hook in batches of rectangles.  Whatever the module turns down
+ * is done by the generic software fall backs.
+ *
+ * The operation hooks may return before the hardware is done, provided the
+ * module has a wait() hook.  The driver calls it before the CPU, scanout
+ * or DRI2 clients access a bo, and before freeing a bo it gave the module.
+ */
+
+#define OMAP_ACCEL_ABI_VERSION	1
+
+struct omap_bo;
+
+/* A pixmap's buffer object, as the module gets to see it */
+struct omap_accel_surface {
+	/* opaque, identifies the bo to wait() */
+	struct omap_bo *bo;
+	/* GEM handle on the DRM fd passed to init() */
+	uint32_t handle;
+	/* in bytes */
+	uint32_t pitch;
+	/* of the pixmap, which may be smaller than its bo */
+	int width, height;
+	int bpp;
+
+	/* composite and scale: pixman format code; composite only: repeat
+	 * type and component alpha
+	 */
+	uint32_t format;
+	int repeat;
+	Bool component_alpha;
+};
+
+/* Destination rectangle, and where it comes from in source and mask */
+struct omap_accel_rect {
+	int src_x, src_y;
+	int mask_x, mask_y;
+	int dst_x, dst_y;
+	int width, height;
+};
+
+struct omap_accel_ops {
+	/* OMAP_ACCEL_ABI_VERSION the module was built against */
+	unsigned int abi_version;
+	const char *name;
+
+	/* Per-screen setup, returning the module's private data passed to
+	 * the other hooks, or NULL if the hardware isn't usable.
+	 */
+	void *(*init)(ScrnInfoPtr pScrn, int fd);
+	void (*fini)(void *priv);
+
+	/* Fill with @pixel, already in @dst's format.  GXcopy, all planes. */
+	Bool (*check_solid)(void *priv, const struct omap_accel_surface *dst);
+	Bool (*solid)(void *priv, const struct omap_accel_surface *dst,
+			uint32_t pixel, const struct omap_accel_rect *rects,
+			int nrects);
+
+	/* Copy between surfaces of the same bpp.  @src and @dst may be the
+	 * same bo, with overlapping rectangles.
+	 */
+	Bool (*check_copy)(void *priv, const struct omap_accel_surface *dst,
+			const struct omap_accel_surface *src);
+	Bool (*copy)(void *priv, const struct omap_accel_surface *dst,
+			const struct omap_accel_surface *src,
+			const struct omap_accel_rect *rects, int nrects);
+
+	/* Render composite with pixman operator @op; @mask may be NULL */
+	Bool (*check_composite)(void *priv, int op,
+			const struct omap_accel_surface *src,
+			const struct omap_accel_surface *mask,
+			const struct omap_accel_surface *dst);
+	Bool (*composite)(void *priv, int op,
+			const struct omap_accel_surface *src,
+			const struct omap_accel_surface *mask,
+			const struct omap_accel_surface *dst,
+			const struct omap_accel_rect *rects, int nrects);
+
+	/* Scale @src_boxes of @src onto @dst_boxes of @dst, filtered when
+	 * @filter is set, converting formats as needed.  For video.
+	 */
+	Bool (*check_scale)(void *priv, const struct omap_accel_surface *dst,
+			const struct omap_accel_surface *src);
+	Bool (*scale)(void *priv, const struct omap_accel_surface *dst,
+			const BoxRec *dst_boxes,
+			const struct omap_accel_surface *src,
+			const BoxRec *src_boxes, int nboxes, Bool filter);
+
+	/* Optional: wait until all operations touching @bo are done */
+	void (*wait)(void *priv, struct omap_bo *bo);
+};
+
+#endif /* OMAP_ACCEL_H_ */
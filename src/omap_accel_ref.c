@@ -0,0 +1,339 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pixman.h>
+
+#include "omap_driver.h"
+#include "omap_exa.h"
+#include "omap_accel.h"
+#include "omap_copy.h"
+
+/*
+ * Reference implementation of the 2D accelerator module interface, on the
+ * CPU.  It is what a module's output can be compared against (AccelModule
+ * "reference"), and it also does operations a module gives up on after
+ * accepting them.
+ */
+
+struct ref_accel {
+	ScrnInfoPtr pScrn;
+};
+
+static void *
+ref_init(ScrnInfoPtr pScrn, int fd)
+{
+	struct ref_accel *ref = calloc(1, sizeof *ref);
+
+	if (ref)
+		ref->pScrn = pScrn;
+	return ref;
+}
+
+static void
+ref_fini(void *priv)
+{
+	free(priv);
+}
+
+static uint8_t *
+ref_begin(struct ref_accel *ref, const struct omap_accel_surface *surface,
+		enum omap_gem_op op)
+{
+	ScrnInfoPtr pScrn = ref->pScrn;
+	uint8_t *ptr = omap_bo_map(surface->bo);
+
+	if (!ptr || omap_bo_cpu_prep(surface->bo, op)) {
+		ERROR_MSG("Unable to access bo for reference 2D operation");
+		return NULL;
+	}
+	return ptr;
+}
+
+static inline uint8_t *
+ref_addr(const struct omap_accel_surface *surface, uint8_t *ptr, int x, int y)
+{
+	return ptr + y * surface->pitch + x * (surface->bpp / 8);
+}
+
+static pixman_image_t *
+ref_image(const struct omap_accel_surface *surface, uint8_t *ptr)
+{
+	pixman_image_t *image;
+
+	image = pixman_image_create_bits(surface->format, surface->width,
+			surface->height, (uint32_t *)ptr, surface->pitch);
+	if (!image)
+		return NULL;
+
+	pixman_image_set_repeat(image, surface->repeat);
+	pixman_image_set_component_alpha(image, surface->component_alpha);
+	return image;
+}
+
+static Bool
+ref_check_solid(void *priv, const struct omap_accel_surface *dst)
+{
+	return dst->bpp == 8 || dst->bpp == 16 || dst->bpp == 32;
+}
+
+static Bool
+ref_solid(void *priv, const struct omap_accel_surface *dst, uint32_t pixel,
+		const struct omap_accel_rect *rects, int nrects)
+{
+	uint32_t pattern;
+	uint8_t *ptr;
+	int i;
+
+	switch (dst->bpp) {
+	case 8:
+		pattern = (pixel & 0xff) * 0x01010101;
+		break;
+	case 16:
+		pattern = (pixel & 0xffff) * 0x00010001;
+		break;
+	case 32:
+		pattern = pixel;
+		break;
+	default:
+		return FALSE;
+	}
+
+	ptr = ref_begin(priv, dst, OMAP_GEM_WRITE);
+	if (!ptr)
+		return FALSE;
+
+	for (i = 0; i < nrects; i++)
+		omap_fill_rect(ref_addr(dst, ptr, rects[i].dst_x,
+					rects[i].dst_y),
+				dst->pitch, pattern,
+				rects[i].width * (dst->bpp / 8),
+				rects[i].height);
+
+	omap_bo_cpu_fini(dst->bo, OMAP_GEM_WRITE);
+	return TRUE;
+}
+
+static Bool
+ref_check_copy(void *priv, const struct omap_accel_surface *dst,
+		const struct omap_accel_surface *src)
+{
+	return src->bpp == dst->bpp && dst->bpp >= 8 && dst->bpp % 8 == 0;
+}
+
+static Bool
+ref_copy(void *priv, const struct omap_accel_surface *dst,
+		const struct omap_accel_surface *src,
+		const struct omap_accel_rect *rects, int nrects)
+{
+	uint8_t *dst_ptr, *src_ptr;
+	Bool overlap = src->bo == dst->bo;
+	int cpp = dst->bpp / 8;
+	int i;
+
+	/* acquire for write first, so that a read of the same bo nests */
+	dst_ptr = ref_begin(priv, dst, OMAP_GEM_WRITE);
+	if (!dst_ptr)
+		return FALSE;
+	src_ptr = ref_begin(priv, src, OMAP_GEM_READ);
+	if (!src_ptr) {
+		omap_bo_cpu_fini(dst->bo, OMAP_GEM_WRITE);
+		return FALSE;
+	}
+
+	for (i = 0; i < nrects; i++) {
+		const struct omap_accel_rect *rect = &rects[i];
+		uint8_t *d = ref_addr(dst, dst_ptr, rect->dst_x, rect->dst_y);
+		uint8_t *s = ref_addr(src, src_ptr, rect->src_x, rect->src_y);
+
+		if (overlap && src->pitch == dst->pitch)
+			omap_move_rect(d, s, dst->pitch, rect->width * cpp,
+					rect->height);
+		else
+			omap_copy_rect(d, dst->pitch, s, src->pitch,
+					rect->width * cpp, rect->height);
+	}
+
+	omap_bo_cpu_fini(src->bo, OMAP_GEM_READ);
+	omap_bo_cpu_fini(dst->bo, OMAP_GEM_WRITE);
+	return TRUE;
+}
+
+static Bool
+ref_check_composite(void *priv, int op, const struct omap_accel_surface *src,
+		const struct omap_accel_surface *mask,
+		const struct omap_accel_surface *dst)
+{
+	if (!pixman_format_supported_source(src->format))
+		return FALSE;
+	if (mask && !pixman_format_supported_source(mask->format))
+		return FALSE;
+	return pixman_format_supported_destination(dst->format);
+}
+
+static Bool
+ref_composite(void *priv, int op, const struct omap_accel_surface *src,
+		const struct omap_accel_surface *mask,
+		const struct omap_accel_surface *dst,
+		const struct omap_accel_rect *rects, int nrects)
+{
+	pixman_image_t *src_image = NULL, *mask_image = NULL, *dst_image;
+	uint8_t *dst_ptr, *src_ptr, *mask_ptr = NULL;
+	Bool ret = FALSE;
+	int i;
+
+	dst_ptr = ref_begin(priv, dst, OMAP_GEM_WRITE);
+	if (!dst_ptr)
+		return FALSE;
+	src_ptr = ref_begin(priv, src, OMAP_GEM_READ);
+	if (!src_ptr)
+		goto fini_dst;
+	if (mask) {
+		mask_ptr = ref_begin(priv, mask, OMAP_GEM_READ);
+		if (!mask_ptr)
+			goto fini_src;
+	}
+
+	dst_image = ref_image(dst, dst_ptr);
+	src_image = ref_image(src, src_ptr);
+	if (mask)
+		mask_image = ref_image(mask, mask_ptr);
+
+	if (dst_image && src_image && (mask_image || !mask)) {
+		for (i = 0; i < nrects; i++)
+			pixman_image_composite32(op, src_image, mask_image,
+					dst_image,
+					rects[i].src_x, rects[i].src_y,
+					rects[i].mask_x, rects[i].mask_y,
+					rects[i].dst_x, rects[i].dst_y,
+					rects[i].width, rects[i].height);
+		ret = TRUE;
+	}
+
+	if (mask_image)
+		pixman_image_unref(mask_image);
+	if (src_image)
+		pixman_image_unref(src_image);
+	if (dst_image)
+		pixman_image_unref(dst_image);
+
+	if (mask)
+		omap_bo_cpu_fini(mask->bo, OMAP_GEM_READ);
+fini_src:
+	omap_bo_cpu_fini(src->bo, OMAP_GEM_READ);
+fini_dst:
+	omap_bo_cpu_fini(dst->bo, OMAP_GEM_WRITE);
+	return ret;
+}
+
+static Bool
+ref_check_scale(void *priv, const struct omap_accel_surface *dst,
+		const struct omap_accel_surface *src)
+{
+	return pixman_format_supported_source(src->format) &&
+			pixman_format_supported_destination(dst->format);
+}
+
+static Bool
+ref_scale(void *priv, const struct omap_accel_surface *dst,
+		const BoxRec *dst_boxes, const struct omap_accel_surface *src,
+		const BoxRec *src_boxes, int nboxes, Bool filter)
+{
+	pixman_image_t *src_image, *dst_image;
+	uint8_t *dst_ptr, *src_ptr;
+	Bool ret = FALSE;
+	int i;
+
+	dst_ptr = ref_begin(priv, dst, OMAP_GEM_WRITE);
+	if (!dst_ptr)
+		return FALSE;
+	src_ptr = ref_begin(priv, src, OMAP_GEM_READ);
+	if (!src_ptr)
+		goto fini_dst;
+
+	dst_image = ref_image(dst, dst_ptr);
+	src_image = ref_image(src, src_ptr);
+	if (!dst_image || !src_image)
+		goto unref;
+
+	/* sample up to the edges rather than blending in transparency */
+	pixman_image_set_repeat(src_image, PIXMAN_REPEAT_PAD);
+	pixman_image_set_filter(src_image, filter ? PIXMAN_FILTER_BILINEAR :
+			PIXMAN_FILTER_NEAREST, NULL, 0);
+
+	for (i = 0; i < nboxes; i++) {
+		const BoxRec *d = &dst_boxes[i];
+		const BoxRec *s = &src_boxes[i];
+		int width = d->x2 - d->x1, height = d->y2 - d->y1;
+		pixman_transform_t transform;
+
+		if (width <= 0 || height <= 0)
+			continue;
+
+		/* destination pixel (x, y) of the box samples the source
+		 * at its box origin plus (x + 0.5, y + 0.5) scaled
+		 */
+		pixman_transform_init_scale(&transform,
+				pixman_double_to_fixed((double)(s->x2 - s->x1) /
+					width),
+				pixman_double_to_fixed((double)(s->y2 - s->y1) /
+					height));
+		transform.matrix[0][2] = pixman_int_to_fixed(s->x1);
+		transform.matrix[1][2] = pixman_int_to_fixed(s->y1);
+		pixman_image_set_transform(src_image, &transform);
+
+		pixman_image_composite32(PIXMAN_OP_SRC, src_image, NULL,
+				dst_image, 0, 0, 0, 0, d->x1, d->y1,
+				width, height);
+	}
+	ret = TRUE;
+
+unref:
+	if (src_image)
+		pixman_image_unref(src_image);
+	if (dst_image)
+		pixman_image_unref(dst_image);
+	omap_bo_cpu_fini(src->bo, OMAP_GEM_READ);
+fini_dst:
+	omap_bo_cpu_fini(dst->bo, OMAP_GEM_WRITE);
+	return ret;
+}
+
+const struct omap_accel_ops omap_accel_ref_ops = {
+	.abi_version = OMAP_ACCEL_ABI_VERSION,
+	.name = "reference",
+	.init = ref_init,
+	.fini = ref_fini,
+	.check_solid = ref_check_solid,
+	.solid = ref_solid,
+	.check_copy = ref_check_copy,
+	.copy = ref_copy,
+	.check_composite = ref_check_composite,
+	.composite = ref_composite,
+	.check_scale = ref_check_scale,
+	.scale = ref_scale,
+};
@@ -0,0 +1,284 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OMAP_COMPOSITE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define OMAP_COMPOSITE_SSE2 1
+#endif
+
+#include "omap_composite.h"
+
+/* x * a / 255, rounded, for each of the four channels of @x */
+static inline uint32_t mul_un8x4(uint32_t x, uint32_t a)
+{
+	uint32_t rb = (x & 0xff00ff) * a + 0x800080;
+	uint32_t ag = ((x >> 8) & 0xff00ff) * a + 0x800080;
+
+	rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+	ag = (ag + ((ag >> 8) & 0xff00ff)) & 0xff00ff00;
+	return rb | ag;
+}
+
+/* x + y, saturated, for each of the four channels */
+static inline uint32_t add_un8x4(uint32_t x, uint32_t y)
+{
+	uint32_t rb = (x & 0xff00ff) + (y & 0xff00ff);
+	uint32_t ag = ((x >> 8) & 0xff00ff) + ((y >> 8) & 0xff00ff);
+
+	rb = (rb | (0x1000100 - ((rb >> 8) & 0xff00ff))) & 0xff00ff;
+	ag = (ag | (0x1000100 - ((ag >> 8) & 0xff00ff))) & 0xff00ff;
+	return rb | (ag << 8);
+}
+
+static inline uint32_t over(uint32_t src, uint32_t dst)
+{
+	uint32_t a = src >> 24;
+
+	if (a == 0xff)
+		return src;
+	return add_un8x4(src, mul_un8x4(dst, 0xff - a));
+}
+
+#if defined(OMAP_COMPOSITE_NEON)
+/* x * y / 255, rounded */
+static inline uint8x8_t mul_un8(uint8x8_t x, uint8x8_t y)
+{
+	uint16x8_t t = vmull_u8(x, y);
+	return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+/* eight pixels at a time, deinterleaved into b, g, r and a */
+static int over_8888_row(uint32_t *dst, const uint32_t *src, int n)
+{
+	int done = 0;
+
+	for (; n >= 8; n -= 8, done += 8) {
+		uint8x8x4_t s = vld4_u8((const uint8_t *)(src + done));
+		uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + done));
+		uint8x8_t ia = vmvn_u8(s.val[3]);
+		int i;
+
+		for (i = 0; i < 4; i++)
+			d.val[i] = vqadd_u8(s.val[i], mul_un8(d.val[i], ia));
+		vst4_u8((uint8_t *)(dst + done), d);
+	}
+	return done;
+}
+
+static int over_solid_a8_row(uint32_t *dst, uint32_t src,
+		const uint8_t *mask, int n)
+{
+	uint8x8_t s[4];
+	int done = 0, i;
+
+	for (i = 0; i < 4; i++)
+		s[i] = vdup_n_u8(src >> (i * 8));
+
+	for (; n >= 8; n -= 8, done += 8) {
+		uint8x8_t m = vld1_u8(mask + done);
+		uint8x8x4_t d;
+		uint8x8_t ia;
+
+		d = vld4_u8((const uint8_t *)(dst + done));
+		ia = vmvn_u8(mul_un8(s[3], m));
+		for (i = 0; i < 4; i++)
+			d.val[i] = vqadd_u8(mul_un8(s[i], m),
+					mul_un8(d.val[i], ia));
+		vst4_u8((uint8_t *)(dst + done), d);
+	}
+	return done;
+}
+
+static int add_a8_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	int done = 0;
+
+	for (; n >= 16; n -= 16, done += 16)
+		vst1q_u8(dst + done, vqaddq_u8(vld1q_u8(dst + done),
+				vld1q_u8(src + done)));
+	return done;
+}
+#elif defined(OMAP_COMPOSITE_SSE2)
+/* x * y / 255, rounded, on 16 bit lanes */
+static inline __m128i mul_un16(__m128i x, __m128i y)
+{
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(0x80));
+	return _mm_mulhi_epu16(t, _mm_set1_epi16(0x101));
+}
+
+/* the alpha of each of the two pixels, in all four of its lanes */
+static inline __m128i expand_alpha(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+/* four pixels at a time, two per 16 bit vector */
+static int over_8888_row(uint32_t *dst, const uint32_t *src, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ff = _mm_set1_epi16(0xff);
+	int done = 0;
+
+	for (; n >= 4; n -= 4, done += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + done));
+		__m128i d, lo, hi;
+		int alpha = _mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_and_si128(s, _mm_set1_epi32(0xff000000)),
+				_mm_set1_epi32(0xff000000)));
+
+		/* fully transparent or fully opaque source pixels */
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(s, zero)) == 0xffff)
+			continue;
+		if ((alpha & 0x8888) == 0x8888) {
+			_mm_storeu_si128((__m128i *)(dst + done), s);
+			continue;
+		}
+
+		d = _mm_loadu_si128((const __m128i *)(dst + done));
+		lo = mul_un16(_mm_unpacklo_epi8(d, zero), _mm_xor_si128(
+				expand_alpha(_mm_unpacklo_epi8(s, zero)), ff));
+		hi = mul_un16(_mm_unpackhi_epi8(d, zero), _mm_xor_si128(
+				expand_alpha(_mm_unpackhi_epi8(s, zero)), ff));
+		d = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+		_mm_storeu_si128((__m128i *)(dst + done), d);
+	}
+	return done;
+}
+
+static int over_solid_a8_row(uint32_t *dst, uint32_t src,
+		const uint8_t *mask, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ff = _mm_set1_epi16(0xff);
+	const __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+	int done = 0;
+
+	for (; n >= 4; n -= 4, done += 4) {
+		__m128i m, d, slo, shi, lo, hi;
+		uint32_t m4;
+
+		memcpy(&m4, mask + done, sizeof(m4));
+		if (!m4)
+			continue;
+		if (m4 == 0xffffffff && (src >> 24) == 0xff) {
+			_mm_storeu_si128((__m128i *)(dst + done),
+					_mm_set1_epi32(src));
+			continue;
+		}
+
+		/* each mask value in all four lanes of its pixel */
+		m = _mm_unpacklo_epi8(_mm_cvtsi32_si128(m4), zero);
+		m = _mm_unpacklo_epi16(m, m);
+		slo = mul_un16(s, _mm_unpacklo_epi32(m, m));
+		shi = mul_un16(s, _mm_unpackhi_epi32(m, m));
+
+		d = _mm_loadu_si128((const __m128i *)(dst + done));
+		lo = mul_un16(_mm_unpacklo_epi8(d, zero),
+				_mm_xor_si128(expand_alpha(slo), ff));
+		hi = mul_un16(_mm_unpackhi_epi8(d, zero),
+				_mm_xor_si128(expand_alpha(shi), ff));
+		d = _mm_packus_epi16(_mm_add_epi16(slo, lo),
+				_mm_add_epi16(shi, hi));
+		_mm_storeu_si128((__m128i *)(dst + done), d);
+	}
+	return done;
+}
+
+static int add_a8_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	int done = 0;
+
+	for (; n >= 16; n -= 16, done += 16)
+		_mm_storeu_si128((__m128i *)(dst + done), _mm_adds_epu8(
+				_mm_loadu_si128((const __m128i *)(dst + done)),
+				_mm_loadu_si128((const __m128i *)(src + done))));
+	return done;
+}
+#else
+static int over_8888_row(uint32_t *dst, const uint32_t *src, int n)
+{
+	return 0;
+}
+
+static int over_solid_a8_row(uint32_t *dst, uint32_t src,
+		const uint8_t *mask, int n)
+{
+	return 0;
+}
+
+static int add_a8_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	return 0;
+}
+#endif
+
+void omap_over_8888_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height)
+{
+	for (; height > 0; height--, dst += dst_pitch, src += src_pitch) {
+		uint32_t *d = (uint32_t *)dst;
+		const uint32_t *s = (const uint32_t *)src;
+		int i;
+
+		for (i = over_8888_row(d, s, width); i < width; i++)
+			d[i] = over(s[i], d[i]);
+	}
+}
+
+void omap_over_solid_a8_rect(uint8_t *dst, int dst_pitch, uint32_t src,
+		const uint8_t *mask, int mask_pitch, int width, int height)
+{
+	for (; height > 0; height--, dst += dst_pitch, mask += mask_pitch) {
+		uint32_t *d = (uint32_t *)dst;
+		int i;
+
+		for (i = over_solid_a8_row(d, src, mask, width); i < width; i++)
+			if (mask[i])
+				d[i] = over(mul_un8x4(src, mask[i]), d[i]);
+	}
+}
+
+void omap_add_a8_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height)
+{
+	for (; height > 0; height--, dst += dst_pitch, src += src_pitch) {
+		int i;
+
+		for (i = add_a8_row(dst, src, width); i < width; i++) {
+			unsigned int sum = dst[i] + src[i];
+
+			dst[i] = sum > 0xff ? 0xff : sum;
+		}
+	}
+}
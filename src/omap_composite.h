@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_COMPOSITE_H_
+#define OMAP_COMPOSITE_H_
+
+#include <stdint.h>
+
+/*
+ * Render OVER of premultiplied a8r8g8b8 pixels from @src onto the 32 bpp
+ * @dst, for a @width x @height pixel rectangle.  The two must not overlap.
+ */
+void omap_over_8888_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height);
+
+/*
+ * Render OVER of the premultiplied a8r8g8b8 colour @src through the a8
+ * @mask onto the 32 bpp @dst, for a @width x @height pixel rectangle.  This
+ * is how glyphs are drawn.
+ */
+void omap_over_solid_a8_rect(uint8_t *dst, int dst_pitch, uint32_t src,
+		const uint8_t *mask, int mask_pitch, int width, int height);
+
+/*
+ * Render ADD of the a8 @src onto the a8 @dst, for a @width x @height pixel
+ * rectangle: how glyphs are gathered into a mask.
+ */
+void omap_add_a8_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height);
+
+#endif /* OMAP_COMPOSITE_H_ */
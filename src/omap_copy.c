@@ -0,0 +1,449 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OMAP_COPY_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define OMAP_COPY_SSE2 1
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#endif
+
+#include "omap_copy.h"
+
+/* how far ahead of the current source position to prefetch */
+#define PREFETCH_DISTANCE	256
+/* ..and when reading from uncached or write-combined buffers, where every
+ * miss goes all the way to memory
+ */
+#define FETCH_PREFETCH_DISTANCE	512
+
+#if defined(OMAP_COPY_NEON) || defined(OMAP_COPY_SSE2)
+static void copy_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	/* Align the destination so every store below is a full aligned
+	 * block, which is what keeps the write-combine buffers happy.
+	 */
+	int head = (16 - ((uintptr_t)dst & 15)) & 15;
+
+	if (head > n)
+		head = n;
+	memmove(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	while (n >= 64) {
+#ifdef OMAP_COPY_NEON
+		uint8x16_t a = vld1q_u8(src);
+		uint8x16_t b = vld1q_u8(src + 16);
+		uint8x16_t c = vld1q_u8(src + 32);
+		uint8x16_t d = vld1q_u8(src + 48);
+
+		__builtin_prefetch(src + PREFETCH_DISTANCE);
+		vst1q_u8(dst, a);
+		vst1q_u8(dst + 16, b);
+		vst1q_u8(dst + 32, c);
+		vst1q_u8(dst + 48, d);
+#else
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+
+		__builtin_prefetch(src + PREFETCH_DISTANCE);
+		_mm_store_si128((__m128i *)dst, a);
+		_mm_store_si128((__m128i *)(dst + 16), b);
+		_mm_store_si128((__m128i *)(dst + 32), c);
+		_mm_store_si128((__m128i *)(dst + 48), d);
+#endif
+		dst += 64;
+		src += 64;
+		n -= 64;
+	}
+
+	while (n >= 16) {
+#ifdef OMAP_COPY_NEON
+		vst1q_u8(dst, vld1q_u8(src));
+#else
+		_mm_store_si128((__m128i *)dst,
+				_mm_loadu_si128((const __m128i *)src));
+#endif
+		dst += 16;
+		src += 16;
+		n -= 16;
+	}
+
+	memmove(dst, src, n);
+}
+
+/* Like copy_row(), but from the end of the row backwards, so that @dst may
+ * overlap @src from above.
+ */
+static void copy_row_backward(uint8_t *dst, const uint8_t *src, int n)
+{
+	uint8_t *d = dst + n;
+	const uint8_t *s = src + n;
+	int tail = (uintptr_t)d & 15;
+
+	if (tail > n)
+		tail = n;
+	d -= tail;
+	s -= tail;
+	memmove(d, s, tail);
+	n -= tail;
+
+	while (n >= 64) {
+#ifdef OMAP_COPY_NEON
+		uint8x16_t a, b, c, e;
+
+		d -= 64;
+		s -= 64;
+		a = vld1q_u8(s);
+		b = vld1q_u8(s + 16);
+		c = vld1q_u8(s + 32);
+		e = vld1q_u8(s + 48);
+
+		__builtin_prefetch(s - PREFETCH_DISTANCE);
+		vst1q_u8(d, a);
+		vst1q_u8(d + 16, b);
+		vst1q_u8(d + 32, c);
+		vst1q_u8(d + 48, e);
+#else
+		__m128i a, b, c, e;
+
+		d -= 64;
+		s -= 64;
+		a = _mm_loadu_si128((const __m128i *)s);
+		b = _mm_loadu_si128((const __m128i *)(s + 16));
+		c = _mm_loadu_si128((const __m128i *)(s + 32));
+		e = _mm_loadu_si128((const __m128i *)(s + 48));
+
+		__builtin_prefetch(s - PREFETCH_DISTANCE);
+		_mm_store_si128((__m128i *)d, a);
+		_mm_store_si128((__m128i *)(d + 16), b);
+		_mm_store_si128((__m128i *)(d + 32), c);
+		_mm_store_si128((__m128i *)(d + 48), e);
+#endif
+		n -= 64;
+	}
+
+	while (n >= 16) {
+		d -= 16;
+		s -= 16;
+#ifdef OMAP_COPY_NEON
+		vst1q_u8(d, vld1q_u8(s));
+#else
+		_mm_store_si128((__m128i *)d,
+				_mm_loadu_si128((const __m128i *)s));
+#endif
+		n -= 16;
+	}
+
+	memmove(dst, src, n);
+}
+#else
+static void copy_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	memmove(dst, src, n);
+}
+
+static void copy_row_backward(uint8_t *dst, const uint8_t *src, int n)
+{
+	memmove(dst, src, n);
+}
+#endif
+
+#if defined(OMAP_COPY_SSE2) || defined(__aarch64__)
+/* Like copy_row(), but with non-temporal stores, which bypass the caches:
+ * the CPU won't read what it uploads, so it should not evict anything.
+ */
+static void stream_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	int head = (16 - ((uintptr_t)dst & 15)) & 15;
+
+	if (head > n)
+		head = n;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	while (n >= 64) {
+#ifdef OMAP_COPY_SSE2
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+
+		__builtin_prefetch(src + PREFETCH_DISTANCE);
+		_mm_stream_si128((__m128i *)dst, a);
+		_mm_stream_si128((__m128i *)(dst + 16), b);
+		_mm_stream_si128((__m128i *)(dst + 32), c);
+		_mm_stream_si128((__m128i *)(dst + 48), d);
+#else
+		uint8x16_t a = vld1q_u8(src);
+		uint8x16_t b = vld1q_u8(src + 16);
+		uint8x16_t c = vld1q_u8(src + 32);
+		uint8x16_t d = vld1q_u8(src + 48);
+
+		__builtin_prefetch(src + PREFETCH_DISTANCE);
+		__asm__ volatile("stnp %q1, %q2, [%0]\n\t"
+				"stnp %q3, %q4, [%0, #32]"
+				: : "r" (dst), "w" (a), "w" (b), "w" (c), "w" (d)
+				: "memory");
+#endif
+		dst += 64;
+		src += 64;
+		n -= 64;
+	}
+
+	copy_row(dst, src, n);
+}
+#else
+/* no non-temporal stores to be had: write-combining is as good as it gets */
+static void stream_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	copy_row(dst, src, n);
+}
+#endif
+
+/* Like copy_row(), but aligning the reads rather than the writes, and
+ * prefetching further ahead, for reading uncached or write-combined memory.
+ * SSE4.1 has streaming loads meant just for that.
+ */
+static void fetch_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	int head = (16 - ((uintptr_t)src & 15)) & 15;
+
+	if (head > n)
+		head = n;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	while (n >= 64) {
+		__builtin_prefetch(src + FETCH_PREFETCH_DISTANCE);
+#if defined(OMAP_COPY_SSE2) && defined(__SSE4_1__)
+		{
+			__m128i *s = (__m128i *)src;
+			__m128i a = _mm_stream_load_si128(s);
+			__m128i b = _mm_stream_load_si128(s + 1);
+			__m128i c = _mm_stream_load_si128(s + 2);
+			__m128i d = _mm_stream_load_si128(s + 3);
+
+			_mm_storeu_si128((__m128i *)dst, a);
+			_mm_storeu_si128((__m128i *)(dst + 16), b);
+			_mm_storeu_si128((__m128i *)(dst + 32), c);
+			_mm_storeu_si128((__m128i *)(dst + 48), d);
+		}
+#elif defined(OMAP_COPY_SSE2)
+		{
+			const __m128i *s = (const __m128i *)src;
+			__m128i a = _mm_load_si128(s);
+			__m128i b = _mm_load_si128(s + 1);
+			__m128i c = _mm_load_si128(s + 2);
+			__m128i d = _mm_load_si128(s + 3);
+
+			_mm_storeu_si128((__m128i *)dst, a);
+			_mm_storeu_si128((__m128i *)(dst + 16), b);
+			_mm_storeu_si128((__m128i *)(dst + 32), c);
+			_mm_storeu_si128((__m128i *)(dst + 48), d);
+		}
+#elif defined(OMAP_COPY_NEON)
+		{
+			uint8x16_t a = vld1q_u8(src);
+			uint8x16_t b = vld1q_u8(src + 16);
+			uint8x16_t c = vld1q_u8(src + 32);
+			uint8x16_t d = vld1q_u8(src + 48);
+
+			vst1q_u8(dst, a);
+			vst1q_u8(dst + 16, b);
+			vst1q_u8(dst + 32, c);
+			vst1q_u8(dst + 48, d);
+		}
+#else
+		memcpy(dst, src, 64);
+#endif
+		dst += 64;
+		src += 64;
+		n -= 64;
+	}
+
+	memcpy(dst, src, n);
+}
+
+void omap_copy_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	/* contiguous rows can go as one long row */
+	if (width == dst_pitch && width == src_pitch) {
+		copy_row(dst, src, width * height);
+		return;
+	}
+
+	for (; height > 0; height--, dst += dst_pitch, src += src_pitch)
+		copy_row(dst, src, width);
+}
+
+void omap_move_rect(uint8_t *dst, const uint8_t *src, int pitch,
+		int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	/* Going forwards and top down only reads source rows that have not
+	 * been written yet if the destination starts before the source;
+	 * otherwise go backwards, bottom up.
+	 */
+	if (dst <= src) {
+		omap_copy_rect(dst, pitch, src, pitch, width, height);
+		return;
+	}
+
+	if (width == pitch) {
+		copy_row_backward(dst, src, width * height);
+		return;
+	}
+
+	dst += (height - 1) * pitch;
+	src += (height - 1) * pitch;
+	for (; height > 0; height--, dst -= pitch, src -= pitch)
+		copy_row_backward(dst, src, width);
+}
+
+void omap_stream_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (width == dst_pitch && width == src_pitch) {
+		stream_row(dst, src, width * height);
+	} else {
+		for (; height > 0; height--, dst += dst_pitch, src += src_pitch)
+			stream_row(dst, src, width);
+	}
+
+#ifdef OMAP_COPY_SSE2
+	/* order the non-temporal stores before whatever comes next */
+	_mm_sfence();
+#elif defined(__aarch64__)
+	__asm__ volatile("dmb ishst" : : : "memory");
+#endif
+}
+
+void omap_fetch_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (width == dst_pitch && width == src_pitch) {
+		fetch_row(dst, src, width * height);
+		return;
+	}
+
+	for (; height > 0; height--, dst += dst_pitch, src += src_pitch)
+		fetch_row(dst, src, width);
+}
+
+static inline uint8_t pattern_byte(const uint8_t *dst, uint32_t pattern)
+{
+	/* little endian: byte n of a pixel is at address phase n */
+	return pattern >> (((uintptr_t)dst & 3) * 8);
+}
+
+static void fill_row(uint8_t *dst, uint32_t pattern, int n)
+{
+#if defined(OMAP_COPY_NEON)
+	uint8x16_t v = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+#elif defined(OMAP_COPY_SSE2)
+	__m128i v = _mm_set1_epi32(pattern);
+#endif
+
+	for (; n > 0 && ((uintptr_t)dst & 15); n--, dst++)
+		*dst = pattern_byte(dst, pattern);
+
+#if defined(OMAP_COPY_NEON) || defined(OMAP_COPY_SSE2)
+	while (n >= 64) {
+#ifdef OMAP_COPY_NEON
+		vst1q_u8(dst, v);
+		vst1q_u8(dst + 16, v);
+		vst1q_u8(dst + 32, v);
+		vst1q_u8(dst + 48, v);
+#else
+		_mm_store_si128((__m128i *)dst, v);
+		_mm_store_si128((__m128i *)(dst + 16), v);
+		_mm_store_si128((__m128i *)(dst + 32), v);
+		_mm_store_si128((__m128i *)(dst + 48), v);
+#endif
+		dst += 64;
+		n -= 64;
+	}
+
+	while (n >= 16) {
+#ifdef OMAP_COPY_NEON
+		vst1q_u8(dst, v);
+#else
+		_mm_store_si128((__m128i *)dst, v);
+#endif
+		dst += 16;
+		n -= 16;
+	}
+#else
+	for (; n >= 4; n -= 4, dst += 4)
+		*(uint32_t *)dst = pattern;
+#endif
+
+	for (; n > 0; n--, dst++)
+		*dst = pattern_byte(dst, pattern);
+}
+
+void omap_fill_rect(uint8_t *dst, int dst_pitch, uint32_t pattern,
+		int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (width == dst_pitch) {
+		fill_row(dst, pattern, width * height);
+		return;
+	}
+
+	for (; height > 0; height--, dst += dst_pitch)
+		fill_row(dst, pattern, width);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_COPY_H_
+#define OMAP_COPY_H_
+
+#include <stdint.h>
+
+/*
+ * Copy a @width x @height byte rectangle from @src to @dst.  The two must
+ * not overlap.  Meant for copies from cached memory into write-combined
+ * scanout buffers: rows are written in whole aligned blocks where possible.
+ */
+void omap_copy_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height);
+
+/*
+ * Like omap_copy_rect(), but @dst and @src may overlap within the same
+ * buffer, as when scrolling.
+ */
+void omap_move_rect(uint8_t *dst, const uint8_t *src, int pitch,
+		int width, int height);
+
+/*
+ * Like omap_copy_rect(), for uploads into a buffer the CPU won't read back:
+ * @dst is written with non-temporal stores where the CPU has them.
+ */
+void omap_stream_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height);
+
+/*
+ * Like omap_copy_rect(), for downloads from uncached or write-combined
+ * buffers: the reads are aligned and prefetched well ahead.
+ */
+void omap_fetch_rect(uint8_t *dst, int dst_pitch, const uint8_t *src,
+		int src_pitch, int width, int height);
+
+/*
+ * Fill a @width x @height byte rectangle at @dst with @pattern, a pixel value
+ * replicated to 32 bits.  @dst and @dst_pitch must be aligned to the pixel
+ * size, so that every pixel starts at the same phase of the pattern.
+ */
+void omap_fill_rect(uint8_t *dst, int dst_pitch, uint32_t pattern,
+		int width, int height);
+
+#endif /* OMAP_COPY_H_ */
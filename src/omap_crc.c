@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "omap_crc.h"
+#include "omap_copy.h"
+
+enum tile_state {
+	TILE_UNTOUCHED = 0,
+	TILE_SKIP,
+	TILE_COPY,
+};
+
+struct omap_crc_tiles {
+	int width, height;	/* in pixels */
+	int cols, rows;		/* in tiles */
+	uint32_t *crc;
+	uint8_t *valid;
+	uint8_t *state;		/* scratch for omap_crc_tiles_copy() */
+};
+
+#if defined(__ARM_FEATURE_CRC32) || defined(__SSE4_2__)
+/* CRC32C, using the CPU's crc instructions */
+static uint32_t crc_row(uint32_t crc, const uint8_t *p, int n)
+{
+	for (; n >= 8; n -= 8, p += 8) {
+		uint64_t v;
+
+		memcpy(&v, p, 8);
+#if defined(__ARM_FEATURE_CRC32)
+		crc = __crc32cd(crc, v);
+#elif defined(__x86_64__)
+		crc = _mm_crc32_u64(crc, v);
+#else
+		/* 32-bit x86 only has the 32-bit form: same crc, low half first */
+		crc = _mm_crc32_u32(crc, (uint32_t)v);
+		crc = _mm_crc32_u32(crc, (uint32_t)(v >> 32));
+#endif
+	}
+	for (; n > 0; n--, p++) {
+#ifdef __ARM_FEATURE_CRC32
+		crc = __crc32cb(crc, *p);
+#else
+		crc = _mm_crc32_u8(crc, *p);
+#endif
+	}
+	return crc;
+}
+#else
+/*
+ * Without crc instructions a table driven crc costs more than the copy it
+ * is meant to save, so settle for a cheaper multiplicative hash.
+ */
+static uint32_t crc_row(uint32_t crc, const uint8_t *p, int n)
+{
+	uint64_t h = crc;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		uint64_t v;
+
+		memcpy(&v, p, 8);
+		h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	for (; n > 0; n--, p++)
+		h = (h ^ *p) * 0x100000001b3ULL;
+	return (uint32_t)(h ^ (h >> 32));
+}
+#endif
+
+struct omap_crc_tiles *omap_crc_tiles_new(int width, int height)
+{
+	struct omap_crc_tiles *tiles;
+	int n;
+
+	tiles = calloc(1, sizeof *tiles);
+	if (!tiles)
+		return NULL;
+
+	tiles->width = width;
+	tiles->height = height;
+	tiles->cols = (width + OMAP_CRC_TILE_SIZE - 1) / OMAP_CRC_TILE_SIZE;
+	tiles->rows = (height + OMAP_CRC_TILE_SIZE - 1) / OMAP_CRC_TILE_SIZE;
+	n = tiles->cols * tiles->rows;
+
+	tiles->crc = calloc(n, sizeof *tiles->crc);
+	tiles->valid = calloc(n, sizeof *tiles->valid);
+	tiles->state = calloc(n, sizeof *tiles->state);
+	if (!tiles->crc || !tiles->valid || !tiles->state) {
+		omap_crc_tiles_free(tiles);
+		return NULL;
+	}
+
+	return tiles;
+}
+
+void omap_crc_tiles_free(struct omap_crc_tiles *tiles)
+{
+	if (!tiles)
+		return;
+
+	free(tiles->crc);
+	free(tiles->valid);
+	free(tiles->state);
+	free(tiles);
+}
+
+/* Clip @box, in source coordinates, to the destination. */
+static Bool
+dst_box(struct omap_crc_tiles *tiles, const BoxRec *box, int src_x,
+		int src_y, BoxPtr out)
+{
+	out->x1 = max(box->x1 - src_x, 0);
+	out->y1 = max(box->y1 - src_y, 0);
+	out->x2 = min(box->x2 - src_x, tiles->width);
+	out->y2 = min(box->y2 - src_y, tiles->height);
+
+	return out->x1 < out->x2 && out->y1 < out->y2;
+}
+
+/* Decide whether tile (@tx, @ty) has to be copied. */
+static void
+check_tile(struct omap_crc_tiles *tiles, int tx, int ty,
+		const uint8_t *src, int src_pitch, int cpp)
+{
+	int i = ty * tiles->cols + tx;
+	int x = tx * OMAP_CRC_TILE_SIZE;
+	int y = ty * OMAP_CRC_TILE_SIZE;
+	int w = min(OMAP_CRC_TILE_SIZE, tiles->width - x) * cpp;
+	int h = min(OMAP_CRC_TILE_SIZE, tiles->height - y);
+	uint32_t crc = ~0;
+
+	src += y * src_pitch + x * cpp;
+	for (; h > 0; h--, src += src_pitch)
+		crc = crc_row(crc, src, w);
+
+	if (tiles->valid[i] && tiles->crc[i] == crc) {
+		tiles->state[i] = TILE_SKIP;
+	} else {
+		tiles->crc[i] = crc;
+		tiles->valid[i] = TRUE;
+		tiles->state[i] = TILE_COPY;
+	}
+}
+
+void omap_crc_tiles_copy(struct omap_crc_tiles *tiles,
+		uint8_t *dst, int dst_pitch, const uint8_t *src, int src_pitch,
+		int cpp, int src_x, int src_y, RegionPtr pRegion)
+{
+	BoxPtr pBox = RegionRects(pRegion);
+	int n = RegionNumRects(pRegion);
+	int i, tx, ty;
+
+	/* src from here on is the source pixel at dst (0, 0) */
+	src += src_y * src_pitch + src_x * cpp;
+
+	/*
+	 * The checksum covers the whole tile, so each tile is checked once,
+	 * when the first box touching it comes along.  Only the damaged part
+	 * of it is copied: the rest of the tile is up to date already.
+	 */
+	for (i = 0; i < n; i++) {
+		BoxRec box;
+
+		if (!dst_box(tiles, &pBox[i], src_x, src_y, &box))
+			continue;
+
+		for (ty = box.y1 / OMAP_CRC_TILE_SIZE;
+		     ty * OMAP_CRC_TILE_SIZE < box.y2; ty++) {
+			int y1 = max(box.y1, ty * OMAP_CRC_TILE_SIZE);
+			int y2 = min(box.y2, (ty + 1) * OMAP_CRC_TILE_SIZE);
+			int run = -1;	/* start of the tiles to copy in a row */
+
+			for (tx = box.x1 / OMAP_CRC_TILE_SIZE;; tx++) {
+				int x = tx * OMAP_CRC_TILE_SIZE;
+				Bool copy = FALSE;
+
+				if (x < box.x2) {
+					int t = ty * tiles->cols + tx;
+
+					if (tiles->state[t] == TILE_UNTOUCHED)
+						check_tile(tiles, tx, ty, src,
+								src_pitch, cpp);
+					copy = tiles->state[t] == TILE_COPY;
+				}
+
+				if (copy && run < 0) {
+					run = max(box.x1, x);
+				} else if (!copy && run >= 0) {
+					int x2 = min(box.x2, x);
+
+					omap_copy_rect(dst + y1 * dst_pitch +
+							run * cpp, dst_pitch,
+							src + y1 * src_pitch +
+							run * cpp, src_pitch,
+							(x2 - run) * cpp, y2 - y1);
+					run = -1;
+				}
+
+				if (x >= box.x2)
+					break;
+			}
+		}
+	}
+
+	memset(tiles->state, TILE_UNTOUCHED, tiles->cols * tiles->rows);
+}
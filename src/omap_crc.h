@@ -0,0 +1,53 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_CRC_H_
+#define OMAP_CRC_H_
+
+#include <stdint.h>
+#include "regionstr.h"
+
+/*
+ * Checksums of the tiles of a buffer, kept to tell which tiles of a frame
+ * really changed.  The checksums describe the current contents of the
+ * buffer, so they are only good as long as the buffer is written by
+ * omap_crc_tiles_copy() alone.
+ */
+#define OMAP_CRC_TILE_SIZE	64
+
+struct omap_crc_tiles;
+
+struct omap_crc_tiles *omap_crc_tiles_new(int width, int height);
+void omap_crc_tiles_free(struct omap_crc_tiles *tiles);
+
+/*
+ * Copy @pRegion of @src to @dst, skipping the tiles of @dst whose contents
+ * would not change.  @pRegion is in @src coordinates, and @dst starts at
+ * (@src_x, @src_y) of @src.  All of @pRegion must lie within @src.
+ */
+void omap_crc_tiles_copy(struct omap_crc_tiles *tiles,
+		uint8_t *dst, int dst_pitch, const uint8_t *src, int src_pitch,
+		int cpp, int src_x, int src_y, RegionPtr pRegion);
+
+#endif /* OMAP_CRC_H_ */
@@ -92,7 +92,8 @@ dri2draw(DrawablePtr pDraw, DRI2BufferPtr buf)
  *    (a) is a WINDOW
  *    (b) has a buffer object, and the buffer object size exactly matches
  *        the drawable size.
- *    (c) has the same dimensions as one of the scanouts
+ *    (c) has the same dimensions as one of the scanouts, or exactly spans
+ *        all enabled crtcs
  *
  * Note: Even if a drawable may be flippable, it will not actually be flipped
  * if it is clipped.
@@ -116,7 +117,8 @@ mayflip(DrawablePtr pDraw, struct omap_bo *back_bo)
 		goto out;
 	}
 
-	if (!drmmode_scanout_from_drawable(pOMAP->scanouts, pDraw)) {
+	if (!drmmode_scanout_from_drawable(pOMAP->scanouts, pDraw) &&
+	    !drmmode_drawable_spans_crtcs(pScrn, pDraw)) {
 		ret = FALSE;
 		goto out;
 	}
@@ -139,7 +141,8 @@ out:
  *    (a) is a WINDOW
  *    (b) has a buffer object, and the buffer object size exactly matches
  *        the drawable size.
- *    (c) has the same dimensions as one of the scanouts
+ *    (c) has the same dimensions as one of the scanouts, or exactly spans
+ *        all enabled crtcs
  *    (d) has exactly one clip region
  *    (e) has exactly one clip region, and the regions dimensions match its own
  */
@@ -236,11 +239,15 @@ OMAPDRI2CreateBuffer(DrawablePtr pDraw, unsigned int attachment,
 		 * a more friendly segfault if we just let it be dereferenced in a few lines */
 	}
 
+	/* the client must not see the buffer before X is done with it */
+	OMAPEXAWaitBo(pScrn, bo);
+
 	DRIBUF(buf)->attachment = attachment;
 	DRIBUF(buf)->pitch = exaGetPixmapPitch(pPixmap);
 	DRIBUF(buf)->cpp = pPixmap->drawable.bitsPerPixel / 8;
 	DRIBUF(buf)->format = format;
-	DRIBUF(buf)->flags = 0;//omap_bo_get_dirty(bo) ? DRI2_ARMSOC_PRIVATE_CRC_DIRTY : 0;
+	DRIBUF(buf)->flags = omap_bo_get_dirty(bo) ?
+			DRI2_ARMSOC_PRIVATE_CRC_DIRTY : 0;
 	buf->pPixmap = pPixmap;
 	buf->previous_canflip = -1;
 
@@ -317,6 +324,12 @@ OMAPDRI2CopyRegion(DrawablePtr pDraw, RegionPtr pRegion,
 			0, 0, pDraw->width, pDraw->height, 0, 0);
 
 	FreeScratchGC(pGC);
+
+	/* The copy may have been queued; the client is free to render to
+	 * the source, or read the destination, as soon as we return.
+	 */
+	OMAPEXAWaitBo(pScrn, OMAPPixmapBo(draw2pix(pSrcDraw)));
+	OMAPEXAWaitBo(pScrn, OMAPPixmapBo(draw2pix(pDstDraw)));
 }
 
 static uint64_t gettime_us(void)
@@ -442,6 +455,7 @@ OMAPDRI2SwapComplete(OMAPDRISwapCmd *cmd)
 				for (i = 0; i < MAX_SCANOUTS; i++) {
 					if (pOMAP->scanouts[i].bo == dst_priv->bo) {
 						pOMAP->scanouts[i].valid = TRUE;
+						pOMAP->scanouts[i].in_root = FALSE;
 						break;
 					}
 				}
@@ -488,6 +502,7 @@ OMAPDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw,
 	OMAPDRI2BufferPtr dst = OMAPBUF(pDstBuffer);
 	OMAPDRISwapCmd *cmd;
 	OMAPPixmapPrivPtr src_priv, dst_priv;
+	OMAPScanoutPtr scanout = NULL;
 	int new_canflip, ret, num_flipped;
 	RegionRec region;
 
@@ -518,19 +533,36 @@ OMAPDRI2ScheduleSwap(ClientPtr client, DrawablePtr pDraw,
 	src_priv = exaGetPixmapDriverPrivate(src->pPixmap);
 	dst_priv = exaGetPixmapDriverPrivate(dst->pPixmap);
 
+	/* nothing queued by X may still touch the buffers being swapped */
+	OMAPEXAWaitBo(pScrn, src_priv->bo);
+	OMAPEXAWaitBo(pScrn, dst_priv->bo);
+
 	/* src bo was just rendered to by GPU so it is not dirty */
 	omap_bo_clear_dirty(src_priv->bo);
 	new_canflip = canflip(pDraw, src_priv->bo);
 
+	/* Drawables spanning several crtcs flip using the span scanout */
+	if (new_canflip && !pOMAP->has_resized) {
+		scanout = drmmode_scanout_from_drawable(pOMAP->scanouts, pDraw);
+		if (!scanout)
+			scanout = drmmode_span_scanout_from_drawable(pScrn,
+					pDraw);
+		if (!scanout)
+			new_canflip = FALSE;
+	}
+
 	/* If we can flip using a crtc scanout, switch the front buffer bo */
 	if (new_canflip && !pOMAP->has_resized) {
 		struct omap_bo *old_bo;
 
 		old_bo = dst_priv->bo;
-		dst_priv->bo = drmmode_scanout_from_drawable(pOMAP->scanouts,
-				pDraw)->bo;
+		dst_priv->bo = scanout->bo;
 		omap_bo_reference(dst_priv->bo);
-		if (!drmmode_set_flip_mode(pScrn)) {
+		if (scanout->span)
+			ret = drmmode_set_span_mode(pScrn);
+		else
+			ret = drmmode_set_flip_mode(pScrn);
+		if (!ret) {
 			ERROR_MSG("Could not set flip mode");
 			new_canflip = FALSE;
 			omap_bo_unreference(dst_priv->bo);
@@ -678,8 +710,11 @@ OMAPDRI2ReuseBufferNotify(DrawablePtr pDraw, DRI2BufferPtr buffer)
 	PixmapPtr pPixmap = omap_buffer->pPixmap;
 	OMAPPixmapPrivPtr omap_priv = exaGetPixmapDriverPrivate(pPixmap);
 
+	OMAPEXAWaitBo(xf86ScreenToScrn(pDraw->pScreen), omap_priv->bo);
+
 	buffer->name = omap_bo_get_name(omap_priv->bo);
-	buffer->flags = 0;// omap_bo_get_dirty(omap_priv->bo) ? DRI2_ARMSOC_PRIVATE_CRC_DIRTY : 0;
+	buffer->flags = omap_bo_get_dirty(omap_priv->bo) ?
+			DRI2_ARMSOC_PRIVATE_CRC_DIRTY : 0;
 }
 
 /**
@@ -710,6 +745,14 @@ OMAPDRI2ScreenInit(ScreenPtr pScreen)
 	};
 	int minor = 1, major = 0;
 
+	/* DRI2 buffers are swapped into the root pixmap as bos, which a
+	 * shadow root pixmap has none of.
+	 */
+	if (pOMAP->shadow_fb) {
+		INFO_MSG("DRI2 disabled with ShadowFB");
+		return TRUE;
+	}
+
 	if (xf86LoaderCheckSymbol("DRI2Version")) {
 		DRI2Version(&major, &minor);
 	}
@@ -734,5 +777,6 @@ OMAPDRI2CloseScreen(ScreenPtr pScreen)
 		DEBUG_MSG("waiting..");
 		drmmode_wait_for_event(pScrn);
 	}
-	DRI2CloseScreen(pScreen);
+	if (!pOMAP->shadow_fb)
+		DRI2CloseScreen(pScreen);
 }
@@ -37,6 +37,7 @@
 #endif
 
 #include "omap_driver.h"
+#include "omap_copy.h"
 #include "compat-api.h"
 
 Bool omapDebug = 0;
@@ -52,6 +53,8 @@ static Bool OMAPScreenInit(SCREEN_INIT_ARGS_DECL);
 static void OMAPLoadPalette(ScrnInfoPtr pScrn, int numColors, int *indices,
 		LOCO * colors, VisualPtr pVisual);
 static Bool OMAPCloseScreen(CLOSE_SCREEN_ARGS_DECL);
+static Bool OMAPCreateScreenResources(ScreenPtr pScreen);
+static void OMAPBlockHandler(BLOCKHANDLER_ARGS_DECL);
 static Bool OMAPSwitchMode(SWITCH_MODE_ARGS_DECL);
 static void OMAPAdjustFrame(ADJUST_FRAME_ARGS_DECL);
 static Bool OMAPEnterVT(VT_FUNC_ARGS_DECL);
@@ -90,11 +93,21 @@ static SymTabRec OMAPChipsets[] = {
 /** Supported options, as enum values. */
 typedef enum {
 	OPTION_DEBUG,
+	OPTION_TEARFREE,
+	OPTION_SHADOW_FB,
+	OPTION_ACCEL_METHOD,
+	OPTION_ACCEL_MODULE,
+	OPTION_WRITEBACK,
 } OMAPOpts;
 
 /** Supported options. */
 static const OptionInfoRec OMAPOptions[] = {
 	{ OPTION_DEBUG,		"Debug",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_TEARFREE,	"TearFree",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_SHADOW_FB,	"ShadowFB",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_ACCEL_METHOD,	"AccelMethod",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_ACCEL_MODULE,	"AccelModule",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_WRITEBACK,	"Writeback",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ -1,			NULL,		OPTV_NONE,	{0},	FALSE }
 };
 
@@ -177,6 +190,15 @@ OMAPMapMem(ScrnInfoPtr pScrn)
 
 	pScrn->displayWidth = omap_bo_pitch(pOMAP->scanout) / (pScrn->bitsPerPixel / 8);
 
+	if (pOMAP->shadow_fb) {
+		pOMAP->shadow = malloc(omap_bo_pitch(pOMAP->scanout) *
+				pScrn->virtualY);
+		if (!pOMAP->shadow) {
+			WARNING_MSG("Error allocating shadow framebuffer, disabling ShadowFB");
+			pOMAP->shadow_fb = FALSE;
+		}
+	}
+
 	return TRUE;
 }
 
@@ -187,6 +209,8 @@ OMAPUnmapMem(ScrnInfoPtr pScrn)
 	OMAPPtr pOMAP = OMAPPTR(pScrn);
 	omap_bo_unreference(pOMAP->scanout);
 	pOMAP->scanout = NULL;
+	free(pOMAP->shadow);
+	pOMAP->shadow = NULL;
 	pScrn->displayWidth = 0;
 	return TRUE;
 }
@@ -403,6 +427,7 @@ OMAPPreInit(ScrnInfoPtr pScrn, int flags)
 	int default_depth, fbbpp;
 	rgb defaultWeight = { 0, 0, 0 };
 	rgb defaultMask = { 0, 0, 0 };
+	const char *accel_method, *accel_module;
 	Gamma defaultGamma = { 0.0, 0.0, 0.0 };
 
 	TRACE_ENTER();
@@ -494,6 +519,31 @@ OMAPPreInit(ScrnInfoPtr pScrn, int flags)
 	/* Determine if the user wants debug messages turned on: */
 	omapDebug = xf86ReturnOptValBool(pOMAP->pOptionInfo, OPTION_DEBUG, FALSE);
 
+	pOMAP->tear_free = xf86ReturnOptValBool(pOMAP->pOptionInfo,
+			OPTION_TEARFREE, FALSE);
+	if (pOMAP->tear_free)
+		CONFIG_MSG("TearFree enabled");
+
+	pOMAP->shadow_fb = xf86ReturnOptValBool(pOMAP->pOptionInfo,
+			OPTION_SHADOW_FB, FALSE);
+	if (pOMAP->shadow_fb)
+		CONFIG_MSG("ShadowFB enabled");
+
+	pOMAP->writeback = xf86ReturnOptValBool(pOMAP->pOptionInfo,
+			OPTION_WRITEBACK, FALSE);
+	if (pOMAP->writeback)
+		CONFIG_MSG("Writeback enabled");
+
+	pOMAP->cpu_exa = TRUE;
+	accel_method = xf86GetOptValString(pOMAP->pOptionInfo,
+			OPTION_ACCEL_METHOD);
+	if (accel_method && !xf86NameCmp(accel_method, "none"))
+		pOMAP->cpu_exa = FALSE;
+	else if (accel_method && xf86NameCmp(accel_method, "cpu"))
+		WARNING_MSG("Unknown AccelMethod \"%s\", using \"cpu\"",
+				accel_method);
+	CONFIG_MSG("AccelMethod: %s", pOMAP->cpu_exa ? "cpu" : "none");
+
 	/*
 	 * Select the video modes:
 	 */
@@ -536,6 +586,15 @@ OMAPPreInit(ScrnInfoPtr pScrn, int flags)
 		goto fail;
 	}
 
+	/* A 2D accelerator module replaces AccelMethod, unless it is unusable */
+	accel_module = xf86GetOptValString(pOMAP->pOptionInfo,
+			OPTION_ACCEL_MODULE);
+	if (accel_module) {
+		pOMAP->accel_ops = OMAPAccelModuleLoad(pScrn, accel_module);
+		if (pOMAP->accel_ops)
+			CONFIG_MSG("AccelModule: %s", accel_module);
+	}
+
 
 	TRACE_EXIT();
 	return TRUE;
@@ -570,6 +629,13 @@ OMAPScreenInit(SCREEN_INIT_ARGS_DECL)
 	 */
 	drmmode_copy_fb(pScrn);
 
+	/* ...and on to the shadow, if rendering goes there instead. */
+	if (pOMAP->shadow_fb)
+		omap_copy_rect(pOMAP->shadow, omap_bo_pitch(pOMAP->scanout),
+				omap_bo_map(pOMAP->scanout),
+				omap_bo_pitch(pOMAP->scanout),
+				omap_bo_pitch(pOMAP->scanout), pScrn->virtualY);
+
 	/* The root window pixmap bo (pOMAP->scanout) has valid contents now,
 	 * so we start out claiming we're in blit mode.
 	 * The root window is displayed when we do:
@@ -627,7 +693,8 @@ OMAPScreenInit(SCREEN_INIT_ARGS_DECL)
 	}
 
 	/* Initialize some generic 2D drawing functions: */
-	if (!fbScreenInit(pScreen, omap_bo_map(pOMAP->scanout),
+	if (!fbScreenInit(pScreen, pOMAP->shadow_fb ? pOMAP->shadow :
+			omap_bo_map(pOMAP->scanout),
 			pScrn->virtualX, pScrn->virtualY,
 			pScrn->xDpi, pScrn->yDpi, pScrn->displayWidth,
 			pScrn->bitsPerPixel)) {
@@ -681,9 +748,15 @@ OMAPScreenInit(SCREEN_INIT_ARGS_DECL)
 	 * miDCInitialize() otherwise stacking order for wrapped ScreenPtr fxns
 	 * ends up in the wrong order.
 	 */
-	pOMAP->pOMAPEXA = InitNullEXA(pScreen, pScrn, pOMAP->drmFD);
+	if (pOMAP->accel_ops)
+		pOMAP->pOMAPEXA = InitAccelEXA(pScreen, pScrn, pOMAP->drmFD,
+				pOMAP->accel_ops);
+	else if (pOMAP->cpu_exa)
+		pOMAP->pOMAPEXA = InitCpuEXA(pScreen, pScrn, pOMAP->drmFD);
+	else
+		pOMAP->pOMAPEXA = InitNullEXA(pScreen, pScrn, pOMAP->drmFD);
 	if (!pOMAP->pOMAPEXA) {
-		ERROR_MSG("InitNullEXA() failed!");
+		ERROR_MSG("EXA initialization failed!");
 		goto fail;
 	}
 
@@ -736,10 +809,15 @@ OMAPScreenInit(SCREEN_INIT_ARGS_DECL)
 	/* Setup power management: */
 	xf86DPMSInit(pScreen, xf86DPMSSet, 0);
 
+	if (!OMAPVideoScreenInit(pScreen))
+		WARNING_MSG("Xv initialization failed");
+
 	pScreen->SaveScreen = xf86SaveScreen;
 
 	/* Wrap some screen functions: */
 	wrap(pOMAP, pScreen, CloseScreen, OMAPCloseScreen);
+	wrap(pOMAP, pScreen, CreateScreenResources, OMAPCreateScreenResources);
+	wrap(pOMAP, pScreen, BlockHandler, OMAPBlockHandler);
 
 	if (!drmmode_screen_init(pScrn)) {
 		ERROR_MSG("drmmode_screen_init() failed!");
@@ -764,6 +842,91 @@ OMAPLoadPalette(ScrnInfoPtr pScrn, int numColors, int *indices,
 }
 
 
+/**
+ * The driver's CreateScreenResources() function.  Once the root pixmap
+ * exists, start tracking damage to it if anything needs to push root
+ * rendering out to other buffers from the block handler.
+ */
+static Bool
+OMAPCreateScreenResources(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	PixmapPtr rootPixmap;
+	Bool ret;
+
+	swap(pOMAP, pScreen, CreateScreenResources);
+	ret = (*pScreen->CreateScreenResources)(pScreen);
+	swap(pOMAP, pScreen, CreateScreenResources);
+	if (!ret)
+		return FALSE;
+
+	if (!pOMAP->tear_free && !pOMAP->shadow_fb && !pOMAP->writeback)
+		return TRUE;
+
+	pOMAP->damage = DamageCreate(NULL, NULL, DamageReportNone, TRUE,
+			pScreen, pScreen);
+	if (!pOMAP->damage) {
+		ERROR_MSG("Failed to create root damage");
+		/* ShadowFB can't do without it */
+		if (pOMAP->shadow_fb)
+			return FALSE;
+		pOMAP->tear_free = FALSE;
+		pOMAP->writeback = FALSE;
+		return TRUE;
+	}
+
+	rootPixmap = pScreen->GetScreenPixmap(pScreen);
+	DamageRegister(&rootPixmap->drawable, pOMAP->damage);
+
+	if (pOMAP->shadow_fb)
+		OMAPShadowInit(pScreen);
+
+	return TRUE;
+}
+
+
+/**
+ * The driver's BlockHandler() function.  Push the root pixmap damage
+ * accumulated while processing the last batch of requests out to the
+ * buffers actually being scanned out.
+ */
+static void
+OMAPBlockHandler(BLOCKHANDLER_ARGS_DECL)
+{
+	SCREEN_PTR(arg);
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	RegionPtr pRegion;
+
+	swap(pOMAP, pScreen, BlockHandler);
+	(*pScreen->BlockHandler)(BLOCKHANDLER_ARGS);
+	swap(pOMAP, pScreen, BlockHandler);
+
+	if (!pScrn->vtSema)
+		return;
+
+	drmmode_cursor_flush(pScrn);
+
+	if (!pOMAP->damage)
+		return;
+
+	/* Called even without new damage, to pick up damage that was held
+	 * back while a previous update was still being flipped in.
+	 */
+	pRegion = DamageRegion(pOMAP->damage);
+	if (pOMAP->shadow_fb)
+		OMAPShadowFlush(pScrn, pRegion);
+	/* Captures go first, else TearFree flips would keep them out */
+	if (pOMAP->writeback)
+		drmmode_writeback_update(pScrn, RegionNotEmpty(pRegion));
+	if (pOMAP->tear_free)
+		drmmode_tearfree_update(pScrn, pRegion);
+
+	DamageEmpty(pOMAP->damage);
+}
+
+
 /**
  * The driver's CloseScreen() function.  This is called at the end of each
  * server generation.  Restore state, unmap the frame buffer (and any other
@@ -781,10 +944,24 @@ OMAPCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 
 	drmmode_close_screen(pScrn);
 
+	OMAPVideoStop(pScrn);
+
 	if (pScrn->vtSema == TRUE)
 		OMAPLeaveVT(VT_FUNC_ARGS(0));
 
+	OMAPShadowFini(pScreen);
+
+	if (pOMAP->damage) {
+		PixmapPtr rootPixmap = pScreen->GetScreenPixmap(pScreen);
+
+		DamageUnregister(&rootPixmap->drawable, pOMAP->damage);
+		DamageDestroy(pOMAP->damage);
+		pOMAP->damage = NULL;
+	}
+
 	unwrap(pOMAP, pScreen, CloseScreen);
+	unwrap(pOMAP, pScreen, CreateScreenResources);
+	unwrap(pOMAP, pScreen, BlockHandler);
 
 	ret = (*pScreen->CloseScreen)(CLOSE_SCREEN_ARGS);
 
@@ -793,6 +970,8 @@ OMAPCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 
 	OMAPDRI2CloseScreen(pScreen);
 
+	OMAPVideoCloseScreen(pScreen);
+
 	OMAPUnmapMem(pScrn);
 
 	pScrn->vtSema = FALSE;
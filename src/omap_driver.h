@@ -54,6 +54,7 @@
 #include "xf86RandR12.h"
 #include "xf86drm.h"
 #include "dri2.h"
+#include "damage.h"
 
 #include "omap_dumb.h"
 #include "omap_msg.h"
@@ -74,7 +75,8 @@ enum OMAP_CHIPSET {
 #define OMAP_USE_PAGE_FLIP_EVENTS	1
 /*#define OMAP_SUPPORT_GAMMA		1 -- Not supported on exynos*/
 
-#define MAX_SCANOUTS		3
+/* One per crtc, plus one for a drawable spanning several crtcs */
+#define MAX_SCANOUTS		4
 #define DRI2_ARMSOC_PRIVATE_CRC_DIRTY 1 /* DRI2 private buffer flag */
 
 typedef struct _OMAPScanout
@@ -85,6 +87,10 @@ typedef struct _OMAPScanout
 	int x;
 	int y;
 	Bool valid;
+	/* The root bo holds the current contents of this scanout */
+	Bool in_root;
+	/* Covers several crtcs, each scanning out its own part of it */
+	Bool span;
 } OMAPScanout, *OMAPScanoutPtr;
 
 enum OMAPFlipMode
@@ -98,6 +104,11 @@ enum OMAPFlipMode
 	OMAP_FLIP_INVALID = 0,
 	OMAP_FLIP_ENABLED,
 	OMAP_FLIP_DISABLED,
+	/*
+	 * Flipping a drawable that covers all crtcs: every crtc scans out
+	 * its own part of the one span scanout.
+	 */
+	OMAP_FLIP_SPAN,
 };
 
 /** The driver's Screen-specific, "private" data structure. */
@@ -137,6 +148,42 @@ typedef struct _OMAPRec
 	int					pending_flips;
 	/* For invalidating backbuffers on Hotplug */
 	Bool			has_resized;
+
+	/**
+	 * TearFree: in blit mode, each crtc scans out of its own pair of
+	 * buffers which are updated from the root scanout in the block
+	 * handler and page flipped.
+	 */
+	Bool				tear_free;
+
+	/**
+	 * ShadowFB: the root pixmap lives in cached system memory, and is
+	 * copied to the root scanout in the block handler.  The shadow has
+	 * the same pitch as the scanout.
+	 */
+	Bool				shadow_fb;
+	void				*shadow;
+	struct omap_shadow	*shadow_flush;
+
+	/* Do EXA operations on the CPU (AccelMethod "cpu"), instead of
+	 * leaving them all to the fb fall backs (AccelMethod "none").
+	 */
+	Bool				cpu_exa;
+
+	/* 2D accelerator module (AccelModule), used instead of AccelMethod */
+	const struct omap_accel_ops	*accel_ops;
+
+	/**
+	 * Writeback: capture what the crtcs display through writeback
+	 * connectors, for recorders.
+	 */
+	Bool				writeback;
+
+	/** Xv overlay ports, in omap_xv.c */
+	struct omap_video		*video;
+
+	/** Damage to the root pixmap since the last block handler. */
+	DamagePtr			damage;
 } OMAPRec, *OMAPPtr;
 
 /*
@@ -190,11 +237,37 @@ OMAPScanoutPtr drmmode_scanout_from_drawable(OMAPScanoutPtr scanouts,
 		DrawablePtr pDraw);
 void drmmode_scanout_set(OMAPScanoutPtr scanouts, int x, int y,
 		struct omap_bo *bo);
+uint32_t drmmode_crtc_id(xf86CrtcPtr crtc);
 int drmmode_crtc_id_from_drawable(ScrnInfoPtr pScrn, DrawablePtr pDraw);
 int drmmode_crtc_index_from_drawable(ScrnInfoPtr pScrn, DrawablePtr pDraw);
 Bool drmmode_set_blit_mode(ScrnInfoPtr pScrn);
 Bool drmmode_set_flip_mode(ScrnInfoPtr pScrn);
+Bool drmmode_set_span_mode(ScrnInfoPtr pScrn);
+Bool drmmode_drawable_spans_crtcs(ScrnInfoPtr pScrn, DrawablePtr pDraw);
+OMAPScanoutPtr drmmode_span_scanout_from_drawable(ScrnInfoPtr pScrn,
+		DrawablePtr pDraw);
 Bool drmmode_update_scanout_from_crtcs(ScrnInfoPtr pScrn);
+Bool drmmode_read_scanouts(ScrnInfoPtr pScrn, int x, int y, int w, int h,
+		uint8_t *dst, int dst_pitch);
+void drmmode_tearfree_update(ScrnInfoPtr pScrn, RegionPtr damage);
+void drmmode_writeback_update(ScrnInfoPtr pScrn, Bool damaged);
+void drmmode_cursor_flush(ScrnInfoPtr pScrn);
+
+/**
+ * ShadowFB flushing, in omap_shadow.c
+ */
+Bool OMAPShadowInit(ScreenPtr pScreen);
+void OMAPShadowFini(ScreenPtr pScreen);
+void OMAPShadowFlush(ScrnInfoPtr pScrn, RegionPtr pRegion);
+void OMAPShadowWait(ScrnInfoPtr pScrn);
+
+
+/**
+ * Xv on overlay planes, in omap_xv.c
+ */
+Bool OMAPVideoScreenInit(ScreenPtr pScreen);
+void OMAPVideoStop(ScrnInfoPtr pScrn);
+void OMAPVideoCloseScreen(ScreenPtr pScreen);
 
 
 /**
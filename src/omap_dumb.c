@@ -35,8 +35,10 @@
 #include <xf86.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include "drm_fourcc.h"
 
 #include "omap_dumb.h"
+#include "omap_crc.h"
 #include "omap_msg.h"
 
 /* device related functions:
@@ -52,6 +54,8 @@ struct omap_device *omap_device_new(int fd, ScrnInfoPtr pScrn)
 
 	new_dev->fd = fd;
 	new_dev->pScrn = pScrn;
+	pthread_mutex_init(&new_dev->lock, NULL);
+	pthread_cond_init(&new_dev->cond, NULL);
 
 	if (!bo_device_init(new_dev))
 		goto err_free_dev;
@@ -71,6 +75,8 @@ struct omap_device *omap_device_new(int fd, ScrnInfoPtr pScrn)
 err_deinit_bodev:
 	bo_device_deinit(new_dev);
 err_free_dev:
+	pthread_cond_destroy(&new_dev->cond);
+	pthread_mutex_destroy(&new_dev->lock);
 	free(new_dev);
 	return NULL;
 }
@@ -78,12 +84,40 @@ err_free_dev:
 void omap_device_del(struct omap_device *dev)
 {
 	bo_device_deinit(dev);
+	pthread_cond_destroy(&dev->cond);
+	pthread_mutex_destroy(&dev->lock);
 	free(dev);
 }
 
 /* buffer-object related functions:
  */
 
+/*
+ * Planar YUV formats keep all their planes in the one bo: the luma plane of
+ * @height rows of the bo's pitch is followed by the chroma plane(s), which
+ * have half as many rows and together take up as many bytes per row.
+ */
+static int omap_bo_planes(uint32_t pixel_format, uint32_t height,
+		uint32_t pitch, uint32_t pitches[4], uint32_t offsets[4])
+{
+	pitches[0] = pitch;
+	offsets[0] = 0;
+
+	switch (pixel_format) {
+	case DRM_FORMAT_NV12:
+		pitches[1] = pitch;
+		offsets[1] = pitch * height;
+		return 2;
+	case DRM_FORMAT_YUV420:
+		pitches[1] = pitches[2] = pitch / 2;
+		offsets[1] = pitch * height;
+		offsets[2] = offsets[1] + pitch / 2 * ((height + 1) / 2);
+		return 3;
+	default:
+		return 1;
+	}
+}
+
 static struct omap_bo *omap_bo_new(struct omap_device *dev, uint32_t width,
 		uint32_t height, uint8_t depth, uint8_t bpp,
 		uint32_t pixel_format)
@@ -99,8 +133,18 @@ static struct omap_bo *omap_bo_new(struct omap_device *dev, uint32_t width,
 	if (!new_buf)
 		return NULL;
 
-	new_buf->priv_bo = bo_ops->bo_create(dev, width, height, flags,
-					     &new_buf->handle, &pitch);
+	/* The backends allocate 32 bpp rows; have them hold the planes */
+	if (pixel_format == DRM_FORMAT_NV12 ||
+			pixel_format == DRM_FORMAT_YUV420)
+		new_buf->priv_bo = bo_ops->bo_create(dev, (width + 3) / 4,
+				height + (height + 1) / 2, flags,
+				&new_buf->handle, &pitch);
+	else if (pixel_format == DRM_FORMAT_YUYV)
+		new_buf->priv_bo = bo_ops->bo_create(dev, (width + 1) / 2,
+				height, flags, &new_buf->handle, &pitch);
+	else
+		new_buf->priv_bo = bo_ops->bo_create(dev, width, height, flags,
+				&new_buf->handle, &pitch);
 	if (!new_buf->priv_bo) {
 		ERROR_MSG("PLATFORM_BO_CREATE(%ux%u flags: 0x%x) failed: %s",
 				width, height, flags, strerror(errno));
@@ -122,9 +166,18 @@ static struct omap_bo *omap_bo_new(struct omap_device *dev, uint32_t width,
 				new_buf->fb_id, width, height, depth, bpp,
 				pitch, new_buf->handle);
 	} else {
-		uint32_t handles[4] = { new_buf->handle };
-		uint32_t pitches[4] = { pitch };
+		uint32_t handles[4] = { 0 };
+		uint32_t pitches[4] = { 0 };
 		uint32_t offsets[4] = { 0 };
+		int i;
+
+		new_buf->num_planes = omap_bo_planes(pixel_format, height,
+				pitch, pitches, offsets);
+		for (i = 0; i < new_buf->num_planes; i++) {
+			handles[i] = new_buf->handle;
+			new_buf->plane_pitch[i] = pitches[i];
+			new_buf->plane_offset[i] = offsets[i];
+		}
 
 		ret = drmModeAddFB2(dev->fd, width, height,
 				pixel_format, handles, pitches, offsets,
@@ -188,6 +241,7 @@ static void omap_bo_del(struct omap_bo *bo)
 				strerror(errno));
 	assert(res == 0);
 	dev->ops->bo_destroy(bo);
+	omap_crc_tiles_free(bo->crc_tiles);
 	free(bo);
 }
 
@@ -258,6 +312,17 @@ uint32_t omap_bo_pitch(struct omap_bo *bo)
 	return bo->pitch;
 }
 
+/* Pitch and offset of @plane, for the planar formats */
+uint32_t omap_bo_plane_pitch(struct omap_bo *bo, int plane)
+{
+	return plane ? bo->plane_pitch[plane] : bo->pitch;
+}
+
+uint32_t omap_bo_plane_offset(struct omap_bo *bo, int plane)
+{
+	return plane ? bo->plane_offset[plane] : 0;
+}
+
 uint32_t omap_bo_depth(struct omap_bo *bo)
 {
 	return bo->depth;
@@ -285,43 +350,174 @@ void *omap_bo_map(struct omap_bo *bo)
 }
 
 int omap_bo_cpu_prep(struct omap_bo *bo, enum omap_gem_op op)
+{
+	return omap_bo_cpu_prep_range(bo, op, NULL);
+}
+
+/* The bytes of @bo holding the pixels from (@x1, @y1) up to (@x2, @y2) */
+void omap_bo_box_range(struct omap_bo *bo, int x1, int y1, int x2, int y2,
+		struct omap_bo_range *range)
+{
+	uint32_t Bpp = omap_bo_Bpp(bo);
+
+	x1 = max(x1, 0);
+	y1 = max(y1, 0);
+	x2 = min(x2, (int)bo->width);
+	y2 = min(y2, (int)bo->height);
+
+	if (x1 >= x2 || y1 >= y2) {
+		range->offset = 0;
+		range->size = 0;
+		return;
+	}
+
+	range->offset = y1 * bo->pitch + x1 * Bpp;
+	range->size = (y2 - y1 - 1) * bo->pitch + (x2 - x1) * Bpp;
+}
+
+static void range_whole(struct omap_bo *bo, struct omap_bo_range *range)
+{
+	range->offset = 0;
+	range->size = bo->pitch * bo->height;
+}
+
+static int range_contains(const struct omap_bo_range *a,
+		const struct omap_bo_range *b)
+{
+	return b->offset >= a->offset &&
+			b->offset + b->size <= a->offset + a->size;
+}
+
+static void range_union(struct omap_bo_range *a,
+		const struct omap_bo_range *b)
+{
+	uint32_t end = max(a->offset + a->size, b->offset + b->size);
+
+	a->offset = min(a->offset, b->offset);
+	a->size = end - a->offset;
+}
+
+/* Called with dev->lock held, which this drops while it waits */
+static void wait_syncing(struct omap_bo *bo)
+{
+	struct omap_device *dev = bo->dev;
+
+	while (bo->syncing)
+		pthread_cond_wait(&dev->cond, &dev->lock);
+}
+
+/*
+ * The backend sync can block on fences, so it runs without dev->lock;
+ * bo->syncing keeps other threads off the bookkeeping meanwhile.
+ */
+static int backend_sync(struct omap_bo *bo, int prep, enum omap_gem_op op,
+		struct omap_bo_range *r)
+{
+	struct omap_device *dev = bo->dev;
+	int ret;
+
+	bo->syncing = TRUE;
+	pthread_mutex_unlock(&dev->lock);
+
+	if (prep)
+		ret = dev->ops->bo_cpu_prep(bo, op, r);
+	else
+		ret = dev->ops->bo_cpu_fini(bo, op, r);
+
+	pthread_mutex_lock(&dev->lock);
+	bo->syncing = FALSE;
+	pthread_cond_broadcast(&dev->cond);
+
+	return ret;
+}
+
+static int cpu_prep(struct omap_bo *bo, enum omap_gem_op op,
+		const struct omap_bo_range *range)
 {
 	struct omap_device *dev = bo->dev;
 	ScrnInfoPtr pScrn = dev->pScrn;
+	struct omap_bo_range r;
 	int ret;
 
+	if (range)
+		r = *range;
+	else
+		range_whole(bo, &r);
+
+	pthread_mutex_lock(&dev->lock);
+	wait_syncing(bo);
+
 	if (bo->acquire_cnt) {
 		if ((op & OMAP_GEM_WRITE) && !bo->acquired_exclusive) {
 			ERROR_MSG("attempting to acquire read locked surface for write");
-			return 1;
+			ret = 1;
+			goto out;
+		}
+		if (!range_contains(&bo->acquired, &r)) {
+			ret = backend_sync(bo, TRUE, op, &r);
+			if (ret)
+				goto out;
+			range_union(&bo->acquired, &r);
 		}
 		bo->acquire_cnt++;
-		return 0;
+		ret = 0;
+		goto out;
 	}
 
-	ret = dev->ops->bo_cpu_prep(bo, op);
+	ret = backend_sync(bo, TRUE, op, &r);
 	if (!ret) {
 		bo->acquired_exclusive = op & OMAP_GEM_WRITE;
+		bo->acquired = r;
 		bo->acquire_cnt++;
 		if (bo->acquired_exclusive) {
 			bo->dirty = TRUE;
 		}
 	}
 
+out:
+	pthread_mutex_unlock(&dev->lock);
 	return ret;
 }
 
+/*
+ * Prepare @range of @bo for CPU access, or all of it for a NULL @range.
+ * Nested calls only go to the backend for what isn't covered already.
+ * This and omap_bo_cpu_fini() may be called from any thread.
+ */
+int omap_bo_cpu_prep_range(struct omap_bo *bo, enum omap_gem_op op,
+		const struct omap_bo_range *range)
+{
+	return cpu_prep(bo, op, range);
+}
+
+/*
+ * Wait until the GPU is done with @bo as far as CPU access with @op is
+ * concerned, without preparing it.  Unlike the rest of the bo functions,
+ * this may be called from any thread.
+ */
+int omap_bo_cpu_wait(struct omap_bo *bo, enum omap_gem_op op)
+{
+	const struct bo_ops *ops = bo->dev->ops;
+
+	return ops->bo_cpu_wait ? ops->bo_cpu_wait(bo, op) : 0;
+}
+
 int omap_bo_cpu_fini(struct omap_bo *bo, enum omap_gem_op op)
 {
 	struct omap_device *dev = bo->dev;
+	int ret = 0;
 
+	pthread_mutex_lock(&dev->lock);
+	wait_syncing(bo);
 	assert(bo->acquire_cnt > 0);
+	if (--bo->acquire_cnt == 0) {
+		struct omap_bo_range r = bo->acquired;
 
-	if (--bo->acquire_cnt != 0) {
-		return 0;
+		ret = backend_sync(bo, FALSE, op, &r);
 	}
+	pthread_mutex_unlock(&dev->lock);
 
-	return dev->ops->bo_cpu_fini(bo, op);
+	return ret;
 }
 
 int omap_bo_get_dirty(struct omap_bo *bo)
@@ -329,8 +525,37 @@ int omap_bo_get_dirty(struct omap_bo *bo)
 	return bo->dirty;
 }
 
+/* For writes which don't go through omap_bo_cpu_prep(), e.g. by a blitter */
+void omap_bo_set_dirty(struct omap_bo *bo)
+{
+	bo->dirty = TRUE;
+}
+
 void omap_bo_clear_dirty(struct omap_bo *bo)
 {
 	bo->dirty = FALSE;
 }
 
+/* Marker of the last queued EXA operation touching the bo, see
+ * OMAPEXARec#WaitBo
+ */
+unsigned int omap_bo_get_marker(struct omap_bo *bo)
+{
+	return bo->marker;
+}
+
+void omap_bo_set_marker(struct omap_bo *bo, unsigned int marker)
+{
+	bo->marker = marker;
+}
+
+/* Tile checksums of the bo, for skipping unchanged tiles when copying to it.
+ * Allocated on first use.
+ */
+struct omap_crc_tiles *omap_bo_crc_tiles(struct omap_bo *bo)
+{
+	if (!bo->crc_tiles)
+		bo->crc_tiles = omap_crc_tiles_new(bo->width, bo->height);
+	return bo->crc_tiles;
+}
+
@@ -25,21 +25,37 @@
 #define OMAP_DUMB_H_
 
 #include <stdint.h>
+#include <pthread.h>
 #include "bo.h"
 
 struct omap_bo;
 struct omap_device;
+struct omap_crc_tiles;
 
 enum omap_gem_op {
 	OMAP_GEM_READ = 0x01,
 	OMAP_GEM_WRITE = 0x02,
 };
 
+/* Bytes of a bo touched by CPU access, so that cache maintenance need not
+ * cover all of it
+ */
+struct omap_bo_range {
+	uint32_t offset;
+	uint32_t size;
+};
+
 struct omap_device {
 	int fd;
 	void *bo_dev;
 	const struct bo_ops *ops;
 	ScrnInfoPtr pScrn;
+	/* guards the CPU access bookkeeping of bos, which the EXA queue
+	 * thread does too; the backend syncs run without it
+	 */
+	pthread_mutex_t lock;
+	/* signalled when a bo stops syncing */
+	pthread_cond_t cond;
 };
 
 struct omap_bo {
@@ -53,10 +69,19 @@ struct omap_bo {
 	uint8_t depth;
 	uint8_t bpp;
 	uint32_t pixel_format;
+	/* planes of the YUV formats, all in this bo */
+	int num_planes;
+	uint32_t plane_pitch[3];
+	uint32_t plane_offset[3];
 	int refcnt;
 	int acquired_exclusive;
 	int acquire_cnt;
+	struct omap_bo_range acquired;
+	/* in the backend's cpu_prep or cpu_fini, see omap_device.lock */
+	int syncing;
 	int dirty;
+	unsigned int marker;
+	struct omap_crc_tiles *crc_tiles;
 };
 
 struct omap_device *omap_device_new(int fd, ScrnInfoPtr pScrn);
@@ -68,9 +93,18 @@ uint32_t omap_bo_handle(struct omap_bo *bo);
 void *omap_bo_map(struct omap_bo *bo);
 
 int omap_bo_cpu_prep(struct omap_bo *bo, enum omap_gem_op op);
+int omap_bo_cpu_prep_range(struct omap_bo *bo, enum omap_gem_op op,
+		const struct omap_bo_range *range);
+int omap_bo_cpu_wait(struct omap_bo *bo, enum omap_gem_op op);
 int omap_bo_cpu_fini(struct omap_bo *bo, enum omap_gem_op op);
+void omap_bo_box_range(struct omap_bo *bo, int x1, int y1, int x2, int y2,
+		struct omap_bo_range *range);
 int omap_bo_get_dirty(struct omap_bo *bo);
+void omap_bo_set_dirty(struct omap_bo *bo);
 void omap_bo_clear_dirty(struct omap_bo *bo);
+unsigned int omap_bo_get_marker(struct omap_bo *bo);
+void omap_bo_set_marker(struct omap_bo *bo, unsigned int marker);
+struct omap_crc_tiles *omap_bo_crc_tiles(struct omap_bo *bo);
 
 struct omap_bo *omap_bo_new_with_depth(struct omap_device *dev, uint32_t width,
 		uint32_t height, uint8_t depth, uint8_t bpp);
@@ -84,6 +118,8 @@ uint32_t omap_bo_bpp(struct omap_bo *bo);
 uint32_t omap_bo_Bpp(struct omap_bo *bo);
 uint32_t omap_bo_pitch(struct omap_bo *bo);
 uint32_t omap_bo_depth(struct omap_bo *bo);
+uint32_t omap_bo_plane_pitch(struct omap_bo *bo, int plane);
+uint32_t omap_bo_plane_offset(struct omap_bo *bo, int plane);
 uint32_t omap_bo_fb(struct omap_bo *bo);
 
 void omap_bo_reference(struct omap_bo *bo);
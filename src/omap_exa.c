@@ -32,6 +32,7 @@
 
 #include "omap_exa.h"
 #include "omap_driver.h"
+#include "omap_copy.h"
 
 /* keep this here, instead of static-inline so submodule doesn't
  * need to know layout of OMAPPtr..
@@ -43,6 +44,35 @@ OMAPEXAPTR(ScrnInfoPtr pScrn)
 	return pOMAP->pOMAPEXA;
 }
 
+/* Beyond this, byte offsets into a 32 bpp pixmap could overflow an int */
+#define OMAP_EXA_MAX_SIZE	16384
+
+/**
+ * Largest pixmap size to give EXA as maxX/maxY, beyond which it does not
+ * accelerate.  Anything the crtcs can scan out must fit, so that the root
+ * pixmap of any layout xrandr allows, such as two 4K monitors side by side,
+ * stays accelerated.  Other pixmaps are plain dumb bos, which have no
+ * limit of their own, so they get at least the traditional 4096.
+ */
+void
+OMAPEXAMaxSize(ScrnInfoPtr pScrn, int *maxX, int *maxY)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+
+	*maxX = min(max(xf86_config->maxWidth, 4096), OMAP_EXA_MAX_SIZE);
+	*maxY = min(max(xf86_config->maxHeight, 4096), OMAP_EXA_MAX_SIZE);
+}
+
+/* Wait for the EXA submodule to finish with @bo, if it works asynchronously */
+void
+OMAPEXAWaitBo(ScrnInfoPtr pScrn, struct omap_bo *bo)
+{
+	OMAPEXAPtr pOMAPEXA = OMAPEXAPTR(pScrn);
+
+	if (bo && pOMAPEXA && pOMAPEXA->WaitBo)
+		pOMAPEXA->WaitBo(pScrn, bo);
+}
+
 /* Common OMAP EXA functions, mostly related to pixmap/buffer allocation.
  * Individual driver submodules can use these directly, or wrap them with
  * there own functions if anything additional is required.  Submodules
@@ -210,6 +240,9 @@ exa_index_to_string(int index)
 	}
 }
 
+static Bool PrepareAccess(PixmapPtr pPixmap, int index, const BoxRec *pBox,
+		Bool prep);
+
 /**
  * Returns TRUE if the bo backing a pixmap has the same dimensions as the
  * pixmap's drawable, and the same pitch as the pixmap.
@@ -277,6 +310,34 @@ static Bool has_fullsize_bo(PixmapPtr pPixmap, struct omap_bo *bo)
  */
 _X_EXPORT Bool
 OMAPPrepareAccess(PixmapPtr pPixmap, int index)
+{
+	return PrepareAccess(pPixmap, index, NULL, TRUE);
+}
+
+/**
+ * As OMAPPrepareAccess(), for access to just the pixels in @pBox, if not
+ * NULL.  Only the bytes of the bo holding those need cache maintenance.
+ */
+Bool
+OMAPPrepareAccessBox(PixmapPtr pPixmap, int index, const BoxRec *pBox)
+{
+	return PrepareAccess(pPixmap, index, pBox, TRUE);
+}
+
+/**
+ * Only map @pPixmap, as OMAPPrepareAccess() would, for access by another
+ * thread, which prepares OMAPPixmapBo() for it with omap_bo_cpu_prep() and
+ * omap_bo_cpu_fini() around the access itself.  Ended with
+ * OMAPFinishAccessMap().
+ */
+Bool
+OMAPPrepareAccessMap(PixmapPtr pPixmap, int index)
+{
+	return PrepareAccess(pPixmap, index, NULL, FALSE);
+}
+
+static Bool
+PrepareAccess(PixmapPtr pPixmap, int index, const BoxRec *pBox, Bool prep)
 {
 	ScreenPtr pScreen = pPixmap->drawable.pScreen;
 	ScrnInfoPtr pScrn = pix2scrn(pPixmap);
@@ -284,6 +345,7 @@ OMAPPrepareAccess(PixmapPtr pPixmap, int index)
 	PixmapPtr rootPixmap;
 	OMAPPixmapPrivPtr priv = exaGetPixmapDriverPrivate(pPixmap);
 	const enum omap_gem_op op = idx2op(index);
+	struct omap_bo_range range, *pRange = NULL;
 	Bool res = FALSE;
 
 	TRACE_ENTER();
@@ -368,8 +430,17 @@ OMAPPrepareAccess(PixmapPtr pPixmap, int index)
 	 * keep mali from writing to it, even after the kernel has released its
 	 * own read lock following the page flip away from this scanout to a
 	 * new scanout buffer.
+	 *
+	 * The box only tells which bytes of the bo are touched when the
+	 * pixmap is mapped from the bo itself.
 	 */
-	if (omap_bo_cpu_prep(priv->bo, op))
+	if (pBox && pPixmap->devPrivate.ptr == omap_bo_map(priv->bo)) {
+		omap_bo_box_range(priv->bo, pBox->x1, pBox->y1,
+				pBox->x2, pBox->y2, &range);
+		pRange = &range;
+	}
+
+	if (prep && omap_bo_cpu_prep_range(priv->bo, op, pRange))
 		goto out;
 
 	res = TRUE;
@@ -400,14 +471,21 @@ OMAPFinishAccess(PixmapPtr pPixmap, int index)
 	TRACE_ENTER();
 	pPixmap->devPrivate.ptr = NULL;
 
-	/* NOTE: can we use EXA migration module to track which parts of the
-	 * buffer was accessed by sw, and pass that info down to kernel to
-	 * do a more precise cache flush..
+	/* Cache maintenance covers whatever was prepared: all of the bo for
+	 * EXA's own accesses, which don't say what they touch, or only the
+	 * box given to OMAPPrepareAccessBox().
 	 */
 	omap_bo_cpu_fini(priv->bo, idx2op(index));
 	TRACE_EXIT();
 }
 
+/* End access set up by OMAPPrepareAccessMap() */
+void
+OMAPFinishAccessMap(PixmapPtr pPixmap, int index)
+{
+	pPixmap->devPrivate.ptr = NULL;
+}
+
 /**
  * PixmapIsOffscreen() is an optional driver replacement to
  * exaPixmapHasGpuCopy(). Set to NULL if you want the standard behaviour
@@ -433,3 +511,71 @@ OMAPPixmapIsOffscreen(PixmapPtr pPixmap)
 	OMAPPixmapPrivPtr priv = exaGetPixmapDriverPrivate(pPixmap);
 	return priv && priv->bo;
 }
+
+/**
+ * UploadToScreen() copies @src into the rectangle (@x, @y, @w, @h) of
+ * @pDst, as for PutImage.  Doing it here rather than through
+ * PrepareAccess() and fb lets the copy use non-temporal stores, so that
+ * large images don't flush the caches on their way to the bo.
+ */
+_X_EXPORT Bool
+OMAPUploadToScreen(PixmapPtr pDst, int x, int y, int w, int h,
+		char *src, int src_pitch)
+{
+	int cpp = pDst->drawable.bitsPerPixel / 8;
+	BoxRec box = { x, y, x + w, y + h };
+	uint8_t *dst;
+
+	if (pDst->drawable.bitsPerPixel % 8)
+		return FALSE;
+
+	OMAPEXAWaitBo(pix2scrn(pDst), OMAPPixmapBo(pDst));
+	if (!OMAPPrepareAccessBox(pDst, EXA_PREPARE_DEST, &box))
+		return FALSE;
+
+	dst = (uint8_t *)pDst->devPrivate.ptr + y * pDst->devKind + x * cpp;
+	omap_stream_rect(dst, pDst->devKind, (const uint8_t *)src, src_pitch,
+			w * cpp, h);
+
+	OMAPFinishAccess(pDst, EXA_PREPARE_DEST);
+	return TRUE;
+}
+
+/**
+ * DownloadFromScreen() copies the rectangle (@x, @y, @w, @h) of @pSrc to
+ * @dst, as for GetImage.  The bo may well be write-combined, which makes
+ * reads slow unless they are aligned and prefetched well ahead.  Reads of the
+ * root pixmap in flip mode come straight from the displayed per-crtc bos.
+ */
+_X_EXPORT Bool
+OMAPDownloadFromScreen(PixmapPtr pSrc, int x, int y, int w, int h,
+		char *dst, int dst_pitch)
+{
+	ScreenPtr pScreen = pSrc->drawable.pScreen;
+	int cpp = pSrc->drawable.bitsPerPixel / 8;
+	BoxRec box = { x, y, x + w, y + h };
+	const uint8_t *src;
+
+	if (pSrc->drawable.bitsPerPixel % 8)
+		return FALSE;
+
+	/* Screenshots in flip mode: read what the crtcs display instead of
+	 * assembling the root bo, or leaving flip mode.
+	 */
+	if (pSrc == pScreen->GetScreenPixmap(pScreen) &&
+			drmmode_read_scanouts(pix2scrn(pSrc), x, y, w, h,
+					(uint8_t *)dst, dst_pitch))
+		return TRUE;
+
+	OMAPEXAWaitBo(pix2scrn(pSrc), OMAPPixmapBo(pSrc));
+	if (!OMAPPrepareAccessBox(pSrc, EXA_PREPARE_SRC, &box))
+		return FALSE;
+
+	src = (const uint8_t *)pSrc->devPrivate.ptr + y * pSrc->devKind +
+			x * cpp;
+	omap_fetch_rect((uint8_t *)dst, dst_pitch, src, pSrc->devKind,
+			w * cpp, h);
+
+	OMAPFinishAccess(pSrc, EXA_PREPARE_SRC);
+	return TRUE;
+}
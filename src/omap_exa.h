@@ -64,6 +64,13 @@ typedef struct _OMAPEXARec
 
 	/* add new fields here at end, to preserve ABI */
 
+	/**
+	 * Optional, for submodules which do operations asynchronously: wait
+	 * until the queued operations touching @bo are done, before it is
+	 * handed to anything outside of EXA (scanout, DRI2 clients).
+	 */
+	void (*WaitBo)(ScrnInfoPtr pScrn, struct omap_bo *bo);
+
 
 	/* padding to keep ABI stable, so an existing EXA submodule
 	 * doesn't need to be recompiled when new fields are added
@@ -78,9 +85,33 @@ typedef struct _OMAPEXARec
  */
 OMAPEXAPtr InitNullEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd);
 
+/**
+ * EXA implementation accelerating 2D operations on the CPU
+ */
+OMAPEXAPtr InitCpuEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd);
+
+struct omap_accel_ops;
+
+/**
+ * EXA implementation handing 2D operations to an accelerator module, and
+ * the loading of those (see omap_accel.h)
+ */
+OMAPEXAPtr InitAccelEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd,
+		const struct omap_accel_ops *ops);
+const struct omap_accel_ops *OMAPAccelModuleLoad(ScrnInfoPtr pScrn,
+		const char *name);
+
+/**
+ * Built-in CPU implementation of the accelerator module interface
+ */
+extern const struct omap_accel_ops omap_accel_ref_ops;
+
 
 OMAPEXAPtr OMAPEXAPTR(ScrnInfoPtr pScrn);
 
+void OMAPEXAWaitBo(ScrnInfoPtr pScrn, struct omap_bo *bo);
+void OMAPEXAMaxSize(ScrnInfoPtr pScrn, int *maxX, int *maxY);
+
 static inline ScrnInfoPtr
 pix2scrn(PixmapPtr pPixmap)
 {
@@ -120,8 +151,15 @@ Bool OMAPModifyPixmapHeader(PixmapPtr pPixmap, int width, int height,
 		pointer pPixData);
 void OMAPWaitMarker(ScreenPtr pScreen, int marker);
 Bool OMAPPrepareAccess(PixmapPtr pPixmap, int index);
+Bool OMAPPrepareAccessBox(PixmapPtr pPixmap, int index, const BoxRec *pBox);
+Bool OMAPPrepareAccessMap(PixmapPtr pPixmap, int index);
 void OMAPFinishAccess(PixmapPtr pPixmap, int index);
+void OMAPFinishAccessMap(PixmapPtr pPixmap, int index);
 Bool OMAPPixmapIsOffscreen(PixmapPtr pPixmap);
+Bool OMAPUploadToScreen(PixmapPtr pDst, int x, int y, int w, int h,
+		char *src, int src_pitch);
+Bool OMAPDownloadFromScreen(PixmapPtr pSrc, int x, int y, int w, int h,
+		char *dst, int dst_pitch);
 
 static inline struct omap_bo *
 OMAPPixmapBo(PixmapPtr pPixmap)
@@ -0,0 +1,545 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "omap_driver.h"
+#include "omap_exa.h"
+#include "omap_accel.h"
+
+#include "exa.h"
+#include "picturestr.h"
+
+/* This file has an EXA implementation handing the 2D operations to an
+ * accelerator module, see omap_accel.h.  Operations are passed on as the
+ * module's surfaces, which refer to the pixmaps' bos, rather than mapped
+ * memory.
+ */
+
+/* rectangles passed to the module in one go */
+#define ACCEL_MAX_RECTS		256
+
+enum accel_type {
+	ACCEL_SOLID,
+	ACCEL_COPY,
+	ACCEL_COMPOSITE,
+};
+
+typedef struct {
+	OMAPEXARec base;
+	ExaDriverPtr exa;
+	ScrnInfoPtr pScrn;
+
+	const struct omap_accel_ops *ops;
+	void *priv;
+	/* for operations the module gives up on after accepting them */
+	void *ref_priv;
+
+	/* the current operation */
+	enum accel_type type;
+	struct omap_accel_surface src, mask, dst;
+	Bool has_mask;
+	uint32_t pixel;
+	int op;
+	int nrects;
+	struct omap_accel_rect rects[ACCEL_MAX_RECTS];
+} OMAPAccelEXARec, *OMAPAccelEXAPtr;
+
+static inline OMAPAccelEXAPtr
+pix2accel(PixmapPtr pPixmap)
+{
+	return (OMAPAccelEXAPtr)OMAPEXAPTR(pix2scrn(pPixmap));
+}
+
+/**
+ * Load the 2D accelerator module @name, or pick the built-in reference one,
+ * returning NULL if it can't be used.
+ */
+const struct omap_accel_ops *
+OMAPAccelModuleLoad(ScrnInfoPtr pScrn, const char *name)
+{
+	const struct omap_accel_ops *ops;
+	char symbol[64];
+
+	if (!xf86NameCmp(name, "reference"))
+		return &omap_accel_ref_ops;
+
+	if (!xf86LoadSubModule(pScrn, name)) {
+		WARNING_MSG("Cannot load 2D accelerator module %s", name);
+		return NULL;
+	}
+
+	snprintf(symbol, sizeof(symbol), "%sAccelOps", name);
+	ops = LoaderSymbol(symbol);
+	if (!ops) {
+		WARNING_MSG("2D accelerator module %s has no %s", name, symbol);
+		return NULL;
+	}
+
+	if (ops->abi_version != OMAP_ACCEL_ABI_VERSION) {
+		WARNING_MSG("2D accelerator module %s has ABI version %u, "
+				"expected %u", name, ops->abi_version,
+				OMAP_ACCEL_ABI_VERSION);
+		return NULL;
+	}
+
+	if (!ops->init || !ops->fini) {
+		WARNING_MSG("2D accelerator module %s lacks init or fini",
+				name);
+		return NULL;
+	}
+
+	return ops;
+}
+
+/*
+ * Describe @pPixmap to the module.  The root pixmap is only passed on in
+ * blit mode: in flip mode it is backed by a per-crtc bo of another size,
+ * and writing it needs a switch to blit mode, which PrepareAccess() does
+ * for the fall backs.
+ */
+static Bool
+SetSurface(struct omap_accel_surface *surface, PixmapPtr pPixmap,
+		PicturePtr pPicture)
+{
+	ScreenPtr pScreen = pPixmap->drawable.pScreen;
+	OMAPPtr pOMAP = OMAPPTR(pix2scrn(pPixmap));
+	struct omap_bo *bo = OMAPPixmapBo(pPixmap);
+
+	if (!bo)
+		return FALSE;
+	if (pPixmap == pScreen->GetScreenPixmap(pScreen) &&
+			bo != pOMAP->scanout)
+		return FALSE;
+
+	surface->bo = bo;
+	surface->handle = omap_bo_handle(bo);
+	surface->pitch = exaGetPixmapPitch(pPixmap);
+	surface->width = pPixmap->drawable.width;
+	surface->height = pPixmap->drawable.height;
+	surface->bpp = pPixmap->drawable.bitsPerPixel;
+
+	if (pPicture) {
+		/* Render formats are pixman format codes, repeat types
+		 * match too
+		 */
+		surface->format = pPicture->format;
+		surface->repeat = pPicture->repeat ?
+				pPicture->repeatType : RepeatNone;
+		surface->component_alpha = pPicture->componentAlpha;
+	} else {
+		surface->format = 0;
+		surface->repeat = RepeatNone;
+		surface->component_alpha = FALSE;
+	}
+	return TRUE;
+}
+
+static void
+Wait(OMAPAccelEXAPtr accel, struct omap_bo *bo)
+{
+	if (accel->ops->wait)
+		accel->ops->wait(accel->priv, bo);
+}
+
+static Bool
+Check(OMAPAccelEXAPtr accel, const struct omap_accel_ops *ops, void *priv)
+{
+	const struct omap_accel_surface *mask =
+			accel->has_mask ? &accel->mask : NULL;
+
+	switch (accel->type) {
+	case ACCEL_SOLID:
+		return ops->check_solid && ops->solid &&
+				ops->check_solid(priv, &accel->dst);
+	case ACCEL_COPY:
+		return ops->check_copy && ops->copy &&
+				ops->check_copy(priv, &accel->dst, &accel->src);
+	case ACCEL_COMPOSITE:
+		return ops->check_composite && ops->composite &&
+				ops->check_composite(priv, accel->op,
+						&accel->src, mask, &accel->dst);
+	}
+	return FALSE;
+}
+
+static Bool
+Run(OMAPAccelEXAPtr accel, const struct omap_accel_ops *ops, void *priv)
+{
+	const struct omap_accel_surface *mask =
+			accel->has_mask ? &accel->mask : NULL;
+
+	switch (accel->type) {
+	case ACCEL_SOLID:
+		return ops->solid(priv, &accel->dst, accel->pixel,
+				accel->rects, accel->nrects);
+	case ACCEL_COPY:
+		return ops->copy(priv, &accel->dst, &accel->src,
+				accel->rects, accel->nrects);
+	case ACCEL_COMPOSITE:
+		return ops->composite(priv, accel->op, &accel->src, mask,
+				&accel->dst, accel->rects, accel->nrects);
+	}
+	return FALSE;
+}
+
+static void
+Flush(OMAPAccelEXAPtr accel)
+{
+	ScrnInfoPtr pScrn = accel->pScrn;
+
+	if (!accel->nrects)
+		return;
+
+	if (!Run(accel, accel->ops, accel->priv)) {
+		/* too late to fall back to fb, so do it here */
+		Wait(accel, accel->dst.bo);
+		if (accel->type != ACCEL_SOLID)
+			Wait(accel, accel->src.bo);
+		if (accel->has_mask)
+			Wait(accel, accel->mask.bo);
+
+		if (!Check(accel, &omap_accel_ref_ops, accel->ref_priv) ||
+				!Run(accel, &omap_accel_ref_ops,
+					accel->ref_priv))
+			ERROR_MSG("Dropped 2D operation the %s module failed",
+					accel->ops->name);
+	}
+
+	/* DRI2 clients track this to know the contents changed */
+	omap_bo_set_dirty(accel->dst.bo);
+	accel->nrects = 0;
+}
+
+static void
+AddRect(OMAPAccelEXAPtr accel, const struct omap_accel_rect *rect)
+{
+	if (rect->width <= 0 || rect->height <= 0)
+		return;
+
+	if (accel->nrects == ACCEL_MAX_RECTS)
+		Flush(accel);
+
+	accel->rects[accel->nrects++] = *rect;
+}
+
+static Bool
+PrepareSolid(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fill_colour)
+{
+	OMAPAccelEXAPtr accel = pix2accel(pPixmap);
+
+	if (!EXA_PM_IS_SOLID(&pPixmap->drawable, planemask))
+		return FALSE;
+
+	switch (alu) {
+	case GXclear:
+		fill_colour = 0;
+		break;
+	case GXset:
+		fill_colour = ~0;
+		break;
+	case GXcopy:
+		break;
+	default:
+		return FALSE;
+	}
+
+	if (!SetSurface(&accel->dst, pPixmap, NULL))
+		return FALSE;
+
+	accel->type = ACCEL_SOLID;
+	accel->has_mask = FALSE;
+	accel->pixel = fill_colour;
+	accel->nrects = 0;
+	return Check(accel, accel->ops, accel->priv);
+}
+
+static void
+Solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
+{
+	struct omap_accel_rect rect = {
+		.dst_x = x1,
+		.dst_y = y1,
+		.width = x2 - x1,
+		.height = y2 - y1,
+	};
+
+	AddRect(pix2accel(pPixmap), &rect);
+}
+
+static void
+DoneSolid(PixmapPtr pPixmap)
+{
+	Flush(pix2accel(pPixmap));
+}
+
+static Bool
+PrepareCopy(PixmapPtr pSrc, PixmapPtr pDst, int xdir, int ydir,
+		int alu, Pixel planemask)
+{
+	OMAPAccelEXAPtr accel = pix2accel(pDst);
+
+	if (alu != GXcopy || !EXA_PM_IS_SOLID(&pDst->drawable, planemask))
+		return FALSE;
+
+	if (!SetSurface(&accel->src, pSrc, NULL) ||
+			!SetSurface(&accel->dst, pDst, NULL))
+		return FALSE;
+
+	accel->type = ACCEL_COPY;
+	accel->has_mask = FALSE;
+	accel->nrects = 0;
+	return Check(accel, accel->ops, accel->priv);
+}
+
+static void
+Copy(PixmapPtr pDst, int srcX, int srcY, int dstX, int dstY,
+		int width, int height)
+{
+	struct omap_accel_rect rect = {
+		.src_x = srcX,
+		.src_y = srcY,
+		.dst_x = dstX,
+		.dst_y = dstY,
+		.width = width,
+		.height = height,
+	};
+
+	AddRect(pix2accel(pDst), &rect);
+}
+
+static void
+DoneCopy(PixmapPtr pDst)
+{
+	Flush(pix2accel(pDst));
+}
+
+static Bool
+CheckPicture(PicturePtr pPicture)
+{
+	/* transforms are left to fb, modules only get plain composites */
+	return pPicture->pDrawable && !pPicture->alphaMap &&
+			!pPicture->transform;
+}
+
+static Bool
+CheckComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture)
+{
+	if (!CheckPicture(pSrcPicture))
+		return FALSE;
+	if (pMaskPicture && !CheckPicture(pMaskPicture))
+		return FALSE;
+	return CheckPicture(pDstPicture);
+}
+
+static Bool
+PrepareComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst)
+{
+	OMAPAccelEXAPtr accel = pix2accel(pDst);
+
+	if (!SetSurface(&accel->src, pSrc, pSrcPicture) ||
+			!SetSurface(&accel->dst, pDst, pDstPicture))
+		return FALSE;
+	if (pMask && !SetSurface(&accel->mask, pMask, pMaskPicture))
+		return FALSE;
+
+	accel->type = ACCEL_COMPOSITE;
+	accel->has_mask = pMask != NULL;
+	accel->op = op;
+	accel->nrects = 0;
+	return Check(accel, accel->ops, accel->priv);
+}
+
+static void
+Composite(PixmapPtr pDst, int srcX, int srcY, int maskX, int maskY,
+		int dstX, int dstY, int width, int height)
+{
+	struct omap_accel_rect rect = {
+		.src_x = srcX,
+		.src_y = srcY,
+		.mask_x = maskX,
+		.mask_y = maskY,
+		.dst_x = dstX,
+		.dst_y = dstY,
+		.width = width,
+		.height = height,
+	};
+
+	AddRect(pix2accel(pDst), &rect);
+}
+
+static void
+DoneComposite(PixmapPtr pDst)
+{
+	Flush(pix2accel(pDst));
+}
+
+static Bool
+PrepareAccess(PixmapPtr pPixmap, int index)
+{
+	struct omap_bo *bo = OMAPPixmapBo(pPixmap);
+
+	if (bo)
+		Wait(pix2accel(pPixmap), bo);
+
+	return OMAPPrepareAccess(pPixmap, index);
+}
+
+/* the module may still be using the bo */
+static void
+DestroyPixmap(ScreenPtr pScreen, void *driverPriv)
+{
+	OMAPPixmapPrivPtr priv = driverPriv;
+
+	if (priv->bo)
+		Wait((OMAPAccelEXAPtr)OMAPEXAPTR(xf86ScreenToScrn(pScreen)),
+				priv->bo);
+
+	OMAPDestroyPixmap(pScreen, driverPriv);
+}
+
+static void
+WaitBo(ScrnInfoPtr pScrn, struct omap_bo *bo)
+{
+	Wait((OMAPAccelEXAPtr)OMAPEXAPTR(pScrn), bo);
+}
+
+static Bool
+CloseScreen(CLOSE_SCREEN_ARGS_DECL)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPAccelEXAPtr accel = (OMAPAccelEXAPtr)OMAPEXAPTR(pScrn);
+
+	accel->ops->fini(accel->priv);
+	omap_accel_ref_ops.fini(accel->ref_priv);
+	accel->priv = NULL;
+	accel->ref_priv = NULL;
+	return TRUE;
+}
+
+static void
+FreeScreen(FREE_SCREEN_ARGS_DECL)
+{
+}
+
+
+OMAPEXAPtr
+InitAccelEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd,
+		const struct omap_accel_ops *ops)
+{
+	OMAPAccelEXAPtr accel;
+	OMAPEXAPtr omap_exa;
+	ExaDriverPtr exa;
+
+	INFO_MSG("Accelerator EXA mode, using %s", ops->name);
+
+	accel = calloc(1, sizeof *accel);
+	omap_exa = (OMAPEXAPtr)accel;
+	if (!accel)
+		goto out;
+
+	accel->pScrn = pScrn;
+	accel->ops = ops;
+
+	accel->priv = ops->init(pScrn, fd);
+	if (!accel->priv) {
+		ERROR_MSG("2D accelerator %s failed to initialize", ops->name);
+		goto free_accel;
+	}
+
+	accel->ref_priv = omap_accel_ref_ops.init(pScrn, fd);
+	if (!accel->ref_priv)
+		goto fini_module;
+
+	exa = exaDriverAlloc();
+	if (!exa)
+		goto fini_ref;
+
+	accel->exa = exa;
+
+	exa->exa_major = EXA_VERSION_MAJOR;
+	exa->exa_minor = EXA_VERSION_MINOR;
+
+	exa->pixmapOffsetAlign = 0;
+	exa->pixmapPitchAlign = 32;
+	exa->flags = EXA_OFFSCREEN_PIXMAPS |
+			EXA_HANDLES_PIXMAPS | EXA_SUPPORTS_PREPARE_AUX;
+	OMAPEXAMaxSize(pScrn, &exa->maxX, &exa->maxY);
+
+	/* Required EXA functions: */
+	exa->WaitMarker = OMAPWaitMarker;
+	exa->CreatePixmap2 = OMAPCreatePixmap;
+	exa->DestroyPixmap = DestroyPixmap;
+	exa->ModifyPixmapHeader = OMAPModifyPixmapHeader;
+
+	exa->PrepareAccess = PrepareAccess;
+	exa->FinishAccess = OMAPFinishAccess;
+	exa->PixmapIsOffscreen = OMAPPixmapIsOffscreen;
+
+	exa->UploadToScreen = OMAPUploadToScreen;
+	exa->DownloadFromScreen = OMAPDownloadFromScreen;
+
+	exa->PrepareSolid = PrepareSolid;
+	exa->Solid = Solid;
+	exa->DoneSolid = DoneSolid;
+
+	exa->PrepareCopy = PrepareCopy;
+	exa->Copy = Copy;
+	exa->DoneCopy = DoneCopy;
+
+	exa->CheckComposite = CheckComposite;
+	exa->PrepareComposite = PrepareComposite;
+	exa->Composite = Composite;
+	exa->DoneComposite = DoneComposite;
+
+	if (!exaDriverInit(pScreen, exa)) {
+		ERROR_MSG("exaDriverInit failed");
+		goto free_exa;
+	}
+
+	omap_exa->CloseScreen = CloseScreen;
+	omap_exa->FreeScreen = FreeScreen;
+	omap_exa->WaitBo = WaitBo;
+
+	return omap_exa;
+
+free_exa:
+	free(exa);
+fini_ref:
+	omap_accel_ref_ops.fini(accel->ref_priv);
+fini_module:
+	ops->fini(accel->priv);
+free_accel:
+	free(accel);
+out:
+	return NULL;
+}
@@ -0,0 +1,1472 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <signal.h>
+#include <pixman.h>
+
+#include "omap_driver.h"
+#include "omap_exa.h"
+#include "omap_copy.h"
+#include "omap_composite.h"
+#include "omap_glyphs.h"
+#include "omap_workers.h"
+
+#include "exa.h"
+#include "picturestr.h"
+
+/* This file has an EXA implementation which does the 2D operations on the
+ * CPU, straight into the mapped buffer objects.  Compared to the fb fall
+ * backs behind InitNullEXA, it avoids a PrepareAccess()/FinishAccess() pair
+ * per operation, and uses wide vector loads and stores instead of fb's
+ * scalar loops.
+ *
+ * On multi-core systems the operations are asynchronous: each Solid, Copy
+ * and Composite is recorded between its Prepare and Done hooks, and queued
+ * to a thread which does the operations in order, handing bands of large
+ * ones to the workers.  The bos an operation touches are tagged with its
+ * marker, so that CPU access to a pixmap only waits for the operations
+ * involving it, and so that the bos can be waited for before scanout or
+ * DRI2 clients get to see them (OMAPEXARec#WaitBo).  The server thread
+ * only maps the pixmaps of an operation; the queue thread prepares their
+ * bos for CPU access right before doing it, which waits for the GPU
+ * without holding up other clients, and finishes the access right after.
+ *
+ * Glyph strings drawn in a solid colour through an a8 mask skip EXA's glyph
+ * code: the glyphs are gathered from a cache of their images into a mask
+ * for the whole string, which is then composited onto the destination in a
+ * single operation, rather than as an operation per glyph.
+ */
+
+/* Fills and composites smaller than this are not worth splitting up.. */
+#define CPU_EXA_SPLIT_PIXELS	(128 * 128)
+/* ..nor into bands of fewer rows than this */
+#define CPU_EXA_MIN_BAND_ROWS	16
+
+/* bands handed to the workers before the next join */
+#define CPU_EXA_MAX_JOBS	64
+
+/* operations queued before submitting another one waits */
+#define CPU_EXA_MAX_QUEUED	64
+
+/* rectangles an operation has room for at first */
+#define CPU_EXA_MIN_RECTS	16
+
+/* glyph strings needing a bigger mask than this are left to EXA */
+#define CPU_EXA_MAX_GLYPH_MASK	(1024 * 1024)
+
+/* bos an operation may touch: the pixmap's own, and for the root pixmap
+ * the root bo, for each of source, mask and destination
+ */
+#define CPU_EXA_MAX_BOS		6
+
+enum cpu_exa_composite {
+	COMPOSITE_PIXMAN,
+	COMPOSITE_SRC_COPY,		/* SRC, or OVER from an opaque format */
+	COMPOSITE_OVER_8888,		/* OVER a8r8g8b8 onto 32 bpp */
+	COMPOSITE_OVER_SOLID_A8,	/* OVER solid colour through a8, glyphs */
+};
+
+/* What the workers need to know about a pixmap and its picture */
+struct cpu_exa_image {
+	uint8_t *ptr;
+	int pitch;
+	int width, height;
+	int cpp;
+	pixman_format_code_t format;
+	pixman_repeat_t repeat;
+	Bool component_alpha;
+};
+
+typedef struct _OMAPCpuEXARec OMAPCpuEXARec, *OMAPCpuEXAPtr;
+struct cpu_exa_op;
+
+/* A rectangle of an operation, or a band of one done by a worker */
+struct cpu_exa_job {
+	const struct cpu_exa_op *op;
+	void (*func)(const struct cpu_exa_op *op, const struct cpu_exa_job *job);
+	int src_x, src_y;
+	int mask_x, mask_y;
+	int dst_x, dst_y;
+	int width, height;
+};
+
+/* A bo the queue thread prepares for CPU access around its operation */
+struct cpu_exa_access {
+	struct omap_bo *bo;
+	enum omap_gem_op op;
+};
+
+/* A Solid, Copy or Composite, from its Prepare hook to its Done hook */
+struct cpu_exa_op {
+	struct cpu_exa_op *next;
+	unsigned int marker;
+
+	/* referenced until the operation is retired */
+	int nbo;
+	struct omap_bo *bos[CPU_EXA_MAX_BOS];
+
+	/* to prepare around doing the operation, one per pixmap at most */
+	int naccess;
+	struct cpu_exa_access access[3];
+
+	struct cpu_exa_image src, mask, dst;
+	Bool has_mask;
+	/* bands of the operation may be done in parallel */
+	Bool parallel;
+
+	/* solid fill */
+	uint32_t pattern;
+
+	/* copy: source and destination share memory, so copies may overlap */
+	Bool copy_overlap;
+
+	/* composite */
+	enum cpu_exa_composite composite;
+	int op;
+	uint32_t solid;
+	/* solid is read from the 1x1 source when the operation is done */
+	Bool solid_src;
+	/* glyphs: the mask, which belongs to the operation */
+	uint8_t *glyph_mask;
+
+	int nrects, max_rects;
+	struct cpu_exa_job *rects;
+};
+
+struct _OMAPCpuEXARec {
+	OMAPEXARec base;
+	ExaDriverPtr exa;
+
+	/* NULL on single-core systems, where operations are done by the
+	 * server thread at their Done hook
+	 */
+	struct omap_workers *workers;
+	/* only used by whichever thread does the operations */
+	int njobs;
+	struct cpu_exa_job jobs[CPU_EXA_MAX_JOBS];
+
+	/* the operation being recorded, and its pixmaps */
+	struct cpu_exa_op *op;
+	PixmapPtr pSrc, pMask, pDst;
+
+	/* marker of the last operation submitted */
+	unsigned int marker;
+
+	Bool threaded;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* protected by lock: */
+	struct cpu_exa_op *queue, **queue_tail;	/* submitted, in order */
+	int nqueued;
+	struct cpu_exa_op *done;		/* done, to be retired */
+	unsigned int done_marker;
+	Bool quit;
+
+	struct omap_glyph_cache *glyph_cache;
+	GlyphsProcPtr SavedGlyphs;
+};
+
+static inline OMAPCpuEXAPtr
+pix2cpu_exa(PixmapPtr pPixmap)
+{
+	return (OMAPCpuEXAPtr)OMAPEXAPTR(pix2scrn(pPixmap));
+}
+
+static void
+SetImage(struct cpu_exa_image *image, PixmapPtr pPixmap, PicturePtr pPicture)
+{
+	image->ptr = pPixmap->devPrivate.ptr;
+	image->pitch = pPixmap->devKind;
+	image->width = pPixmap->drawable.width;
+	image->height = pPixmap->drawable.height;
+	image->cpp = pPixmap->drawable.bitsPerPixel / 8;
+
+	if (!pPicture)
+		return;
+
+	/* Render formats are pixman format codes, repeat types match too */
+	image->format = pPicture->format;
+	image->repeat = pPicture->repeat ? pPicture->repeatType : RepeatNone;
+	image->component_alpha = pPicture->componentAlpha;
+}
+
+static inline uint8_t *
+ImageAddr(const struct cpu_exa_image *image, int x, int y)
+{
+	return image->ptr + y * image->pitch + x * image->cpp;
+}
+
+static void
+AddBo(struct cpu_exa_op *op, struct omap_bo *bo)
+{
+	int i;
+
+	for (i = 0; i < op->nbo; i++)
+		if (op->bos[i] == bo)
+			return;
+
+	omap_bo_reference(bo);
+	op->bos[op->nbo++] = bo;
+}
+
+/* Keep the memory @pPixmap is mapped from until @op is retired */
+static void
+AddPixmapBos(struct cpu_exa_op *op, PixmapPtr pPixmap)
+{
+	ScreenPtr pScreen = pPixmap->drawable.pScreen;
+	OMAPPtr pOMAP = OMAPPTR(pix2scrn(pPixmap));
+
+	AddBo(op, OMAPPixmapBo(pPixmap));
+
+	/* root pixmap reads in flip mode may go to the root bo instead */
+	if (pPixmap == pScreen->GetScreenPixmap(pScreen))
+		AddBo(op, pOMAP->scanout);
+}
+
+static void
+FreeOp(struct cpu_exa_op *op)
+{
+	int i;
+
+	for (i = 0; i < op->nbo; i++)
+		omap_bo_unreference(op->bos[i]);
+	free(op->glyph_mask);
+	free(op->rects);
+	free(op);
+}
+
+/*
+ * Prepare CPU access to @pPixmap for @op.  With the queue thread, the
+ * pixmap is only mapped here, and its bo is prepared by the queue thread
+ * around doing @op, so that the cache maintenance brackets the CPU's
+ * accesses.
+ */
+static Bool
+PrepareOpPixmap(OMAPCpuEXAPtr cpu_exa, struct cpu_exa_op *op,
+		PixmapPtr pPixmap, int index)
+{
+	struct cpu_exa_access *access;
+
+	if (!cpu_exa->threaded)
+		return OMAPPrepareAccess(pPixmap, index);
+
+	if (!OMAPPrepareAccessMap(pPixmap, index))
+		return FALSE;
+
+	access = &op->access[op->naccess++];
+	access->bo = OMAPPixmapBo(pPixmap);
+	access->op = index == EXA_PREPARE_DEST ?
+			OMAP_GEM_READ | OMAP_GEM_WRITE : OMAP_GEM_READ;
+	return TRUE;
+}
+
+static void
+FinishOpPixmap(OMAPCpuEXAPtr cpu_exa, PixmapPtr pPixmap, int index)
+{
+	if (cpu_exa->threaded)
+		OMAPFinishAccessMap(pPixmap, index);
+	else
+		OMAPFinishAccess(pPixmap, index);
+}
+
+/*
+ * Prepare CPU access to the pixmaps of an operation, each only once, and
+ * start recording it.  This does not wait for earlier operations: they are
+ * done in order.
+ */
+static Bool
+PrepareOp(OMAPCpuEXAPtr cpu_exa, PixmapPtr pSrc, PixmapPtr pMask,
+		PixmapPtr pDst)
+{
+	struct cpu_exa_op *op;
+
+	op = calloc(1, sizeof *op);
+	if (!op)
+		return FALSE;
+
+	if (!PrepareOpPixmap(cpu_exa, op, pDst, EXA_PREPARE_DEST))
+		goto free_op;
+	if (pSrc && pSrc != pDst && !PrepareOpPixmap(cpu_exa, op, pSrc,
+			EXA_PREPARE_SRC))
+		goto finish_dst;
+	if (pMask && pMask != pSrc && pMask != pDst &&
+			!PrepareOpPixmap(cpu_exa, op, pMask, EXA_PREPARE_MASK))
+		goto finish_src;
+
+	AddPixmapBos(op, pDst);
+	if (pSrc)
+		AddPixmapBos(op, pSrc);
+	if (pMask)
+		AddPixmapBos(op, pMask);
+
+	cpu_exa->op = op;
+	cpu_exa->pSrc = pSrc;
+	cpu_exa->pMask = pMask;
+	cpu_exa->pDst = pDst;
+	return TRUE;
+
+finish_src:
+	if (pSrc && pSrc != pDst)
+		FinishOpPixmap(cpu_exa, pSrc, EXA_PREPARE_SRC);
+finish_dst:
+	FinishOpPixmap(cpu_exa, pDst, EXA_PREPARE_DEST);
+free_op:
+	free(op);
+	return FALSE;
+}
+
+static void
+FinishOpAccess(OMAPCpuEXAPtr cpu_exa)
+{
+	PixmapPtr pSrc = cpu_exa->pSrc;
+	PixmapPtr pMask = cpu_exa->pMask;
+	PixmapPtr pDst = cpu_exa->pDst;
+
+	if (pMask && pMask != pSrc && pMask != pDst)
+		FinishOpPixmap(cpu_exa, pMask, EXA_PREPARE_MASK);
+	if (pSrc && pSrc != pDst)
+		FinishOpPixmap(cpu_exa, pSrc, EXA_PREPARE_SRC);
+	FinishOpPixmap(cpu_exa, pDst, EXA_PREPARE_DEST);
+	cpu_exa->pSrc = NULL;
+	cpu_exa->pMask = NULL;
+	cpu_exa->pDst = NULL;
+}
+
+static void
+RunJob(void *data)
+{
+	struct cpu_exa_job *job = data;
+
+	job->func(job->op, job);
+}
+
+/* Wait for the workers to finish the bands handed to them */
+static void
+Join(OMAPCpuEXAPtr cpu_exa)
+{
+	if (!cpu_exa->njobs)
+		return;
+
+	omap_workers_wait(cpu_exa->workers);
+	cpu_exa->njobs = 0;
+}
+
+/*
+ * Do @rect with @func, split into horizontal bands for the workers when it
+ * is large enough.  The last band is done right away by the calling thread;
+ * the others are only known to be done after Join().
+ */
+static void
+Dispatch(OMAPCpuEXAPtr cpu_exa, struct cpu_exa_job *rect)
+{
+	int nbands, rows, y;
+
+	nbands = omap_workers_count(cpu_exa->workers) + 1;
+	if (nbands > rect->height / CPU_EXA_MIN_BAND_ROWS)
+		nbands = rect->height / CPU_EXA_MIN_BAND_ROWS;
+
+	if (!rect->op->parallel || nbands < 2 ||
+			rect->width * rect->height < CPU_EXA_SPLIT_PIXELS) {
+		rect->func(rect->op, rect);
+		return;
+	}
+
+	rows = (rect->height + nbands - 1) / nbands;
+	for (y = 0; y + rows < rect->height; y += rows) {
+		struct cpu_exa_job *job;
+
+		if (cpu_exa->njobs == CPU_EXA_MAX_JOBS)
+			Join(cpu_exa);
+
+		job = &cpu_exa->jobs[cpu_exa->njobs++];
+		*job = *rect;
+		job->src_y += y;
+		job->mask_y += y;
+		job->dst_y += y;
+		job->height = rows;
+		omap_workers_queue(cpu_exa->workers, RunJob, job);
+	}
+
+	rect->src_y += y;
+	rect->mask_y += y;
+	rect->dst_y += y;
+	rect->height -= y;
+	rect->func(rect->op, rect);
+}
+
+static void
+ExecuteRects(OMAPCpuEXAPtr cpu_exa, struct cpu_exa_op *op,
+		const struct cpu_exa_job *rects, int nrects)
+{
+	int i;
+
+	/* Not at Prepare: an operation filling the source may have been
+	 * queued ahead of this one, and the source prepared for the CPU only
+	 * now.
+	 */
+	if (op->solid_src) {
+		op->solid = *(uint32_t *)op->src.ptr;
+		if (op->src.format == PICT_x8r8g8b8)
+			op->solid |= 0xff000000;
+	}
+
+	for (i = 0; i < nrects; i++) {
+		struct cpu_exa_job rect = rects[i];
+
+		rect.op = op;
+		Dispatch(cpu_exa, &rect);
+	}
+	Join(cpu_exa);
+}
+
+/*
+ * Do @rects of a queued @op, with its bos prepared for CPU access just
+ * around them.  The GPU is waited for first without the bo lock held, so
+ * that the server thread's own CPU accesses don't wait on it too.  An
+ * operation whose bos can't be prepared is dropped.
+ */
+static void
+ExecuteOp(OMAPCpuEXAPtr cpu_exa, struct cpu_exa_op *op,
+		const struct cpu_exa_job *rects, int nrects)
+{
+	int i, prepared;
+
+	for (prepared = 0; prepared < op->naccess; prepared++) {
+		const struct cpu_exa_access *access = &op->access[prepared];
+
+		omap_bo_cpu_wait(access->bo, access->op);
+		if (omap_bo_cpu_prep(access->bo, access->op))
+			break;
+	}
+
+	if (prepared == op->naccess)
+		ExecuteRects(cpu_exa, op, rects, nrects);
+
+	for (i = 0; i < prepared; i++)
+		omap_bo_cpu_fini(op->access[i].bo, op->access[i].op);
+}
+
+static void *
+QueueThread(void *arg)
+{
+	OMAPCpuEXAPtr cpu_exa = arg;
+	struct cpu_exa_op *op;
+
+	pthread_mutex_lock(&cpu_exa->lock);
+	for (;;) {
+		while (!cpu_exa->queue && !cpu_exa->quit)
+			pthread_cond_wait(&cpu_exa->cond, &cpu_exa->lock);
+		if (!cpu_exa->queue)
+			break;
+
+		/* it stays at the head of the queue until done, so that
+		 * the server thread can append to it meanwhile
+		 */
+		op = cpu_exa->queue;
+		pthread_mutex_unlock(&cpu_exa->lock);
+
+		ExecuteOp(cpu_exa, op, op->rects, op->nrects);
+
+		pthread_mutex_lock(&cpu_exa->lock);
+		cpu_exa->queue = op->next;
+		if (!cpu_exa->queue)
+			cpu_exa->queue_tail = &cpu_exa->queue;
+		cpu_exa->nqueued--;
+		cpu_exa->done_marker = op->marker;
+		op->next = cpu_exa->done;
+		cpu_exa->done = op;
+		pthread_cond_broadcast(&cpu_exa->cond);
+	}
+	pthread_mutex_unlock(&cpu_exa->lock);
+
+	return NULL;
+}
+
+/* Free the operations which are done.  Only the server thread touches bo
+ * reference counts, so this is not left to the queue thread.
+ */
+static void
+Retire(OMAPCpuEXAPtr cpu_exa)
+{
+	struct cpu_exa_op *op, *next;
+
+	pthread_mutex_lock(&cpu_exa->lock);
+	op = cpu_exa->done;
+	cpu_exa->done = NULL;
+	pthread_mutex_unlock(&cpu_exa->lock);
+
+	for (; op; op = next) {
+		next = op->next;
+		FreeOp(op);
+	}
+}
+
+/*
+ * Wait until the operation with @marker is done, or everything is, which
+ * covers markers too old to compare.
+ */
+static void
+WaitFor(OMAPCpuEXAPtr cpu_exa, unsigned int marker)
+{
+	if (!cpu_exa->threaded)
+		return;
+
+	pthread_mutex_lock(&cpu_exa->lock);
+	while (cpu_exa->queue && (int)(marker - cpu_exa->done_marker) > 0)
+		pthread_cond_wait(&cpu_exa->cond, &cpu_exa->lock);
+	pthread_mutex_unlock(&cpu_exa->lock);
+
+	Retire(cpu_exa);
+}
+
+/* Wait until everything submitted is done */
+static void
+WaitIdle(OMAPCpuEXAPtr cpu_exa)
+{
+	WaitFor(cpu_exa, cpu_exa->marker);
+}
+
+/*
+ * Finish recording the current operation and hand it to the queue thread,
+ * or do it right away without one.
+ */
+static void
+Submit(OMAPCpuEXAPtr cpu_exa)
+{
+	struct cpu_exa_op *op = cpu_exa->op;
+	int i;
+
+	cpu_exa->op = NULL;
+
+	if (!op->nrects) {
+		FinishOpAccess(cpu_exa);
+		FreeOp(op);
+		return;
+	}
+
+	op->marker = ++cpu_exa->marker;
+	for (i = 0; i < op->nbo; i++)
+		omap_bo_set_marker(op->bos[i], op->marker);
+
+	/* without the queue thread, the access covers the operation */
+	if (!cpu_exa->threaded) {
+		ExecuteRects(cpu_exa, op, op->rects, op->nrects);
+		FinishOpAccess(cpu_exa);
+		FreeOp(op);
+		return;
+	}
+
+	/* with it, the pixmaps were only mapped */
+	FinishOpAccess(cpu_exa);
+
+	pthread_mutex_lock(&cpu_exa->lock);
+	while (cpu_exa->nqueued == CPU_EXA_MAX_QUEUED)
+		pthread_cond_wait(&cpu_exa->cond, &cpu_exa->lock);
+	*cpu_exa->queue_tail = op;
+	cpu_exa->queue_tail = &op->next;
+	cpu_exa->nqueued++;
+	pthread_cond_broadcast(&cpu_exa->cond);
+	pthread_mutex_unlock(&cpu_exa->lock);
+
+	Retire(cpu_exa);
+}
+
+static void
+AddRect(OMAPCpuEXAPtr cpu_exa, const struct cpu_exa_job *rect)
+{
+	struct cpu_exa_op *op = cpu_exa->op;
+
+	if (op->nrects == op->max_rects) {
+		int max_rects = op->max_rects ?
+				op->max_rects * 2 : CPU_EXA_MIN_RECTS;
+		struct cpu_exa_job *rects;
+
+		rects = realloc(op->rects, max_rects * sizeof *rects);
+		if (!rects) {
+			/* Do what was recorded so far and @rect right away,
+			 * once the queue is empty and can't get in the way.
+			 */
+			WaitIdle(cpu_exa);
+			ExecuteOp(cpu_exa, op, op->rects, op->nrects);
+			ExecuteOp(cpu_exa, op, rect, 1);
+			op->nrects = 0;
+			return;
+		}
+		op->rects = rects;
+		op->max_rects = max_rects;
+	}
+
+	op->rects[op->nrects++] = *rect;
+}
+
+/* Replicate @pixel to 32 bits, or return FALSE for unsupported depths */
+static Bool
+solid_pattern(PixmapPtr pPixmap, Pixel pixel, uint32_t *pattern)
+{
+	switch (pPixmap->drawable.bitsPerPixel) {
+	case 8:
+		*pattern = (pixel & 0xff) * 0x01010101;
+		return TRUE;
+	case 16:
+		*pattern = (pixel & 0xffff) * 0x00010001;
+		return TRUE;
+	case 32:
+		*pattern = pixel;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void
+SolidRect(const struct cpu_exa_op *op, const struct cpu_exa_job *job)
+{
+	const struct cpu_exa_image *dst = &op->dst;
+
+	omap_fill_rect(ImageAddr(dst, job->dst_x, job->dst_y), dst->pitch,
+			op->pattern, job->width * dst->cpp, job->height);
+}
+
+static Bool
+PrepareSolid(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fill_colour)
+{
+	OMAPCpuEXAPtr cpu_exa = pix2cpu_exa(pPixmap);
+	struct cpu_exa_op *op;
+	uint32_t pattern;
+
+	if (!EXA_PM_IS_SOLID(&pPixmap->drawable, planemask))
+		return FALSE;
+
+	switch (alu) {
+	case GXclear:
+		fill_colour = 0;
+		break;
+	case GXset:
+		fill_colour = ~0;
+		break;
+	case GXcopy:
+		break;
+	default:
+		return FALSE;
+	}
+
+	if (!solid_pattern(pPixmap, fill_colour, &pattern))
+		return FALSE;
+
+	if (!PrepareOp(cpu_exa, NULL, NULL, pPixmap))
+		return FALSE;
+
+	op = cpu_exa->op;
+	SetImage(&op->dst, pPixmap, NULL);
+	op->parallel = TRUE;
+	op->pattern = pattern;
+	return TRUE;
+}
+
+static void
+Solid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
+{
+	OMAPCpuEXAPtr cpu_exa = pix2cpu_exa(pPixmap);
+	struct cpu_exa_op *op = cpu_exa->op;
+	struct cpu_exa_job rect = {
+		.func = SolidRect,
+		.dst_x = x1,
+		.dst_y = y1,
+		.width = x2 - x1,
+		.height = y2 - y1,
+	};
+
+	if (x1 >= x2 || y1 >= y2)
+		return;
+
+	/* Region fills come as bands of boxes; merge a box into the one
+	 * above it when they line up, so it is filled as one rectangle.
+	 */
+	if (op->nrects) {
+		struct cpu_exa_job *last = &op->rects[op->nrects - 1];
+
+		if (last->dst_x == x1 && last->width == rect.width &&
+				last->dst_y + last->height == y1) {
+			last->height += rect.height;
+			return;
+		}
+	}
+
+	AddRect(cpu_exa, &rect);
+}
+
+static void
+DoneSolid(PixmapPtr pPixmap)
+{
+	Submit(pix2cpu_exa(pPixmap));
+}
+
+static void
+CopyRect(const struct cpu_exa_op *op, const struct cpu_exa_job *job)
+{
+	const struct cpu_exa_image *src = &op->src;
+	const struct cpu_exa_image *dst = &op->dst;
+
+	if (op->copy_overlap)
+		omap_move_rect(ImageAddr(dst, job->dst_x, job->dst_y),
+				ImageAddr(src, job->src_x, job->src_y),
+				dst->pitch, job->width * dst->cpp, job->height);
+	else
+		omap_copy_rect(ImageAddr(dst, job->dst_x, job->dst_y),
+				dst->pitch,
+				ImageAddr(src, job->src_x, job->src_y),
+				src->pitch, job->width * dst->cpp, job->height);
+}
+
+static Bool
+PrepareCopy(PixmapPtr pSrc, PixmapPtr pDst, int xdir, int ydir,
+		int alu, Pixel planemask)
+{
+	OMAPCpuEXAPtr cpu_exa = pix2cpu_exa(pDst);
+	int bpp = pDst->drawable.bitsPerPixel;
+	struct cpu_exa_op *op;
+
+	if (alu != GXcopy || !EXA_PM_IS_SOLID(&pDst->drawable, planemask))
+		return FALSE;
+
+	if (pSrc->drawable.bitsPerPixel != bpp || bpp < 8 || bpp % 8)
+		return FALSE;
+
+	if (!PrepareOp(cpu_exa, pSrc, NULL, pDst))
+		return FALSE;
+
+	op = cpu_exa->op;
+	SetImage(&op->src, pSrc, NULL);
+	SetImage(&op->dst, pDst, NULL);
+
+	/* The rows are copied in whatever order is safe for the addresses
+	 * involved, which covers both xdir and ydir.  That also holds when
+	 * two pixmaps share one bo, e.g. the root pixmap and a DRI2 front
+	 * buffer.  Such copies are not split up, as bands could overwrite
+	 * what the others still have to read.
+	 */
+	op->copy_overlap = op->src.ptr == op->dst.ptr &&
+			op->src.pitch == op->dst.pitch;
+	op->parallel = op->src.ptr != op->dst.ptr;
+	return TRUE;
+}
+
+static void
+Copy(PixmapPtr pDst, int srcX, int srcY, int dstX, int dstY,
+		int width, int height)
+{
+	struct cpu_exa_job rect = {
+		.func = CopyRect,
+		.src_x = srcX,
+		.src_y = srcY,
+		.dst_x = dstX,
+		.dst_y = dstY,
+		.width = width,
+		.height = height,
+	};
+
+	AddRect(pix2cpu_exa(pDst), &rect);
+}
+
+static void
+DoneCopy(PixmapPtr pDst)
+{
+	Submit(pix2cpu_exa(pDst));
+}
+
+static Bool
+CheckPicture(PicturePtr pPicture, Bool dst)
+{
+	if (!pPicture->pDrawable || pPicture->alphaMap)
+		return FALSE;
+
+	/* the filters would need translating, so leave transforms to fb */
+	if (pPicture->transform)
+		return FALSE;
+
+	if (dst)
+		return pixman_format_supported_destination(pPicture->format);
+	return pixman_format_supported_source(pPicture->format);
+}
+
+static Bool
+CheckComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture)
+{
+	if (!CheckPicture(pSrcPicture, FALSE))
+		return FALSE;
+	if (pMaskPicture && !CheckPicture(pMaskPicture, FALSE))
+		return FALSE;
+	return CheckPicture(pDstPicture, TRUE);
+}
+
+static Bool
+IsARGB32(PicturePtr pPicture)
+{
+	return pPicture->format == PICT_a8r8g8b8 ||
+			pPicture->format == PICT_x8r8g8b8;
+}
+
+/* a 1x1 repeating a8r8g8b8 or x8r8g8b8 picture, as used for text colour */
+static Bool
+IsSolid(PicturePtr pPicture, PixmapPtr pPixmap)
+{
+	return IsARGB32(pPicture) && pPicture->repeat &&
+			pPicture->repeatType == RepeatNormal &&
+			pPixmap->drawable.width == 1 &&
+			pPixmap->drawable.height == 1;
+}
+
+static enum cpu_exa_composite
+CompositePath(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pDst)
+{
+	CARD32 src_format = pSrcPicture->format;
+	CARD32 dst_format = pDstPicture->format;
+
+	if (!pMaskPicture) {
+		if (pSrcPicture->repeat)
+			return COMPOSITE_PIXMAN;
+
+		/* OVER from a format without alpha is SRC */
+		if (op == PictOpOver && PICT_FORMAT_A(src_format) == 0)
+			op = PictOpSrc;
+
+		if (op == PictOpSrc && (src_format == dst_format ||
+				(src_format == PICT_a8r8g8b8 &&
+				 dst_format == PICT_x8r8g8b8)) &&
+				PICT_FORMAT_BPP(dst_format) >= 8)
+			return COMPOSITE_SRC_COPY;
+
+		if (op == PictOpOver && src_format == PICT_a8r8g8b8 &&
+				IsARGB32(pDstPicture) &&
+				pSrc->devPrivate.ptr != pDst->devPrivate.ptr)
+			return COMPOSITE_OVER_8888;
+
+		return COMPOSITE_PIXMAN;
+	}
+
+	if (op == PictOpOver && pMaskPicture->format == PICT_a8 &&
+			!pMaskPicture->repeat && !pMaskPicture->componentAlpha &&
+			IsSolid(pSrcPicture, pSrc) && IsARGB32(pDstPicture))
+		return COMPOSITE_OVER_SOLID_A8;
+
+	return COMPOSITE_PIXMAN;
+}
+
+static pixman_image_t *
+CreateImage(const struct cpu_exa_image *image)
+{
+	pixman_image_t *pixman_image;
+
+	pixman_image = pixman_image_create_bits(image->format, image->width,
+			image->height, (uint32_t *)image->ptr, image->pitch);
+	if (!pixman_image)
+		return NULL;
+
+	pixman_image_set_repeat(pixman_image, image->repeat);
+	pixman_image_set_component_alpha(pixman_image,
+			image->component_alpha);
+	return pixman_image;
+}
+
+/*
+ * Images are made for each rectangle, so that the workers do not share
+ * them: pixman updates an image's cached state as it composites.
+ */
+static void
+CompositePixman(const struct cpu_exa_op *op, const struct cpu_exa_job *job)
+{
+	pixman_image_t *src, *mask = NULL, *dst;
+
+	src = CreateImage(&op->src);
+	dst = CreateImage(&op->dst);
+	if (op->has_mask)
+		mask = CreateImage(&op->mask);
+
+	if (src && dst && (mask || !op->has_mask))
+		pixman_image_composite32(op->op, src, mask, dst,
+				job->src_x, job->src_y,
+				job->mask_x, job->mask_y,
+				job->dst_x, job->dst_y,
+				job->width, job->height);
+
+	if (src)
+		pixman_image_unref(src);
+	if (mask)
+		pixman_image_unref(mask);
+	if (dst)
+		pixman_image_unref(dst);
+}
+
+static void
+CompositeRect(const struct cpu_exa_op *op, const struct cpu_exa_job *job)
+{
+	const struct cpu_exa_image *src = &op->src;
+	const struct cpu_exa_image *mask = &op->mask;
+	const struct cpu_exa_image *dst = &op->dst;
+
+	switch (op->composite) {
+	case COMPOSITE_SRC_COPY:
+		if (src->ptr == dst->ptr)
+			omap_move_rect(ImageAddr(dst, job->dst_x, job->dst_y),
+					ImageAddr(src, job->src_x, job->src_y),
+					dst->pitch, job->width * dst->cpp,
+					job->height);
+		else
+			omap_copy_rect(ImageAddr(dst, job->dst_x, job->dst_y),
+					dst->pitch,
+					ImageAddr(src, job->src_x, job->src_y),
+					src->pitch, job->width * dst->cpp,
+					job->height);
+		break;
+	case COMPOSITE_OVER_8888:
+		omap_over_8888_rect(ImageAddr(dst, job->dst_x, job->dst_y),
+				dst->pitch,
+				ImageAddr(src, job->src_x, job->src_y),
+				src->pitch, job->width, job->height);
+		break;
+	case COMPOSITE_OVER_SOLID_A8:
+		omap_over_solid_a8_rect(ImageAddr(dst, job->dst_x, job->dst_y),
+				dst->pitch, op->solid,
+				ImageAddr(mask, job->mask_x, job->mask_y),
+				mask->pitch, job->width, job->height);
+		break;
+	case COMPOSITE_PIXMAN:
+		CompositePixman(op, job);
+		break;
+	}
+}
+
+static Bool
+PrepareComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture,
+		PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst)
+{
+	OMAPCpuEXAPtr cpu_exa = pix2cpu_exa(pDst);
+	struct cpu_exa_op *cpu_op;
+
+	if (!PrepareOp(cpu_exa, pSrc, pMask, pDst))
+		return FALSE;
+
+	cpu_op = cpu_exa->op;
+	SetImage(&cpu_op->src, pSrc, pSrcPicture);
+	SetImage(&cpu_op->dst, pDst, pDstPicture);
+	if (pMask)
+		SetImage(&cpu_op->mask, pMask, pMaskPicture);
+	cpu_op->has_mask = pMask != NULL;
+
+	/* Bands reading what other bands write have to be done in order */
+	cpu_op->parallel = cpu_op->src.ptr != cpu_op->dst.ptr &&
+			(!pMask || cpu_op->mask.ptr != cpu_op->dst.ptr);
+
+	cpu_op->op = op;
+	cpu_op->composite = CompositePath(op, pSrcPicture, pMaskPicture,
+			pDstPicture, pSrc, pDst);
+	cpu_op->solid_src = cpu_op->composite == COMPOSITE_OVER_SOLID_A8;
+	return TRUE;
+}
+
+static void
+Composite(PixmapPtr pDst, int srcX, int srcY, int maskX, int maskY,
+		int dstX, int dstY, int width, int height)
+{
+	struct cpu_exa_job rect = {
+		.func = CompositeRect,
+		.src_x = srcX,
+		.src_y = srcY,
+		.mask_x = maskX,
+		.mask_y = maskY,
+		.dst_x = dstX,
+		.dst_y = dstY,
+		.width = width,
+		.height = height,
+	};
+
+	AddRect(pix2cpu_exa(pDst), &rect);
+}
+
+static void
+DoneComposite(PixmapPtr pDst)
+{
+	Submit(pix2cpu_exa(pDst));
+}
+
+static int
+MarkSync(ScreenPtr pScreen)
+{
+	OMAPCpuEXAPtr cpu_exa = (OMAPCpuEXAPtr)OMAPEXAPTR(
+			xf86ScreenToScrn(pScreen));
+
+	return (int)cpu_exa->marker;
+}
+
+/*
+ * EXA waits for its last marker before any CPU access, but that access is
+ * always through PrepareAccess(), which waits for just the operations on
+ * the pixmap concerned.  So only clean up after what is done.
+ */
+static void
+WaitMarker(ScreenPtr pScreen, int marker)
+{
+	Retire((OMAPCpuEXAPtr)OMAPEXAPTR(xf86ScreenToScrn(pScreen)));
+}
+
+static Bool
+PrepareAccess(PixmapPtr pPixmap, int index)
+{
+	struct omap_bo *bo = OMAPPixmapBo(pPixmap);
+
+	if (bo)
+		WaitFor(pix2cpu_exa(pPixmap), omap_bo_get_marker(bo));
+
+	return OMAPPrepareAccess(pPixmap, index);
+}
+
+static void
+WaitBo(ScrnInfoPtr pScrn, struct omap_bo *bo)
+{
+	WaitFor((OMAPCpuEXAPtr)OMAPEXAPTR(pScrn), omap_bo_get_marker(bo));
+}
+
+/* The colour of a solid source picture, as premultiplied a8r8g8b8 */
+static Bool
+GetSolid(PicturePtr pPicture, uint32_t *solid)
+{
+	PixmapPtr pPixmap;
+
+	if (pPicture->pSourcePict) {
+		if (pPicture->pSourcePict->type != SourcePictTypeSolidFill)
+			return FALSE;
+		*solid = pPicture->pSourcePict->solidFill.color;
+		return TRUE;
+	}
+
+	pPixmap = draw2pix(pPicture->pDrawable);
+	if (!pPixmap || pPicture->alphaMap || !IsSolid(pPicture, pPixmap))
+		return FALSE;
+
+	if (!OMAPPixmapBo(pPixmap)) {
+		*solid = *(uint32_t *)pPixmap->devPrivate.ptr;
+	} else {
+		if (!PrepareAccess(pPixmap, EXA_PREPARE_SRC))
+			return FALSE;
+		*solid = *(uint32_t *)pPixmap->devPrivate.ptr;
+		OMAPFinishAccess(pPixmap, EXA_PREPARE_SRC);
+	}
+
+	if (pPicture->format == PICT_x8r8g8b8)
+		*solid |= 0xff000000;
+	return TRUE;
+}
+
+/* Add the image of @glyph to the mask at @mask, through the glyph cache */
+static Bool
+GlyphToMask(OMAPCpuEXAPtr cpu_exa, ScreenPtr pScreen, GlyphPtr glyph,
+		uint8_t *mask, int mask_pitch)
+{
+	struct omap_glyph_cache *cache = cpu_exa->glyph_cache;
+	int width = glyph->info.width, height = glyph->info.height;
+	PicturePtr pPicture;
+	PixmapPtr pPixmap;
+	const uint8_t *bits;
+	int pitch;
+	Bool has_bo;
+
+	bits = omap_glyph_cache_find(cache, glyph, PICT_a8, &pitch);
+	if (bits) {
+		omap_add_a8_rect(mask, mask_pitch, bits, pitch, width, height);
+		return TRUE;
+	}
+
+	pPicture = GetGlyphPicture(glyph, pScreen);
+	if (!pPicture || pPicture->format != PICT_a8)
+		return FALSE;
+
+	pPixmap = draw2pix(pPicture->pDrawable);
+	has_bo = OMAPPixmapBo(pPixmap) != NULL;
+	if (has_bo && !PrepareAccess(pPixmap, EXA_PREPARE_SRC))
+		return FALSE;
+
+	bits = omap_glyph_cache_add(cache, glyph, PICT_a8,
+			pPixmap->devPrivate.ptr, pPixmap->devKind, &pitch);
+	if (!bits) {
+		bits = pPixmap->devPrivate.ptr;
+		pitch = pPixmap->devKind;
+	}
+	omap_add_a8_rect(mask, mask_pitch, bits, pitch, width, height);
+
+	if (has_bo)
+		OMAPFinishAccess(pPixmap, EXA_PREPARE_SRC);
+	return TRUE;
+}
+
+/*
+ * Add the glyphs to the a8 @mask, whose top left corner is at (@x1, @y1)
+ * in the glyphs' coordinates, the way Render does with a mask format.
+ */
+static Bool
+GlyphsToMask(OMAPCpuEXAPtr cpu_exa, ScreenPtr pScreen, uint8_t *mask,
+		int mask_pitch, int x1, int y1, int nlist, GlyphListPtr list,
+		GlyphPtr *glyphs)
+{
+	int x = 0, y = 0;
+
+	omap_glyph_cache_begin(cpu_exa->glyph_cache);
+
+	for (; nlist > 0; nlist--, list++) {
+		int n;
+
+		x += list->xOff;
+		y += list->yOff;
+		for (n = list->len; n > 0; n--) {
+			GlyphPtr glyph = *glyphs++;
+
+			if (glyph->info.width && glyph->info.height &&
+					!GlyphToMask(cpu_exa, pScreen, glyph,
+						mask + (y - glyph->info.y - y1) *
+						mask_pitch +
+						(x - glyph->info.x - x1),
+						mask_pitch))
+				return FALSE;
+
+			x += glyph->info.xOff;
+			y += glyph->info.yOff;
+		}
+	}
+	return TRUE;
+}
+
+/* Offset from screen coordinates to those of @pDrawable's @pPixmap */
+static void
+ScreenToPixmap(DrawablePtr pDrawable, PixmapPtr pPixmap, int *xoff, int *yoff)
+{
+#ifdef COMPOSITE
+	/* redirected windows have pixmaps of their own */
+	if (pDrawable->type == DRAWABLE_WINDOW) {
+		*xoff = -pPixmap->screen_x;
+		*yoff = -pPixmap->screen_y;
+		return;
+	}
+#endif
+	*xoff = 0;
+	*yoff = 0;
+}
+
+/*
+ * OVER of a solid colour through a8 glyphs, with an a8 mask format, onto a
+ * 32 bpp destination: gather the glyphs into a mask on the server thread,
+ * and composite it as one operation.  Returns FALSE, having drawn nothing,
+ * for anything else.
+ */
+static Bool
+GlyphsSolidA8(OMAPCpuEXAPtr cpu_exa, CARD8 op, PicturePtr pSrc,
+		PicturePtr pDst, PictFormatPtr maskFormat, int nlist,
+		GlyphListPtr list, GlyphPtr *glyphs)
+{
+	DrawablePtr pDrawable = pDst->pDrawable;
+	PixmapPtr pPixmap = draw2pix(pDrawable);
+	struct cpu_exa_op *cpu_op;
+	RegionRec region;
+	BoxRec extents;
+	BoxPtr box;
+	uint32_t solid;
+	uint8_t *mask;
+	int width, height, pitch, xoff, yoff, nbox;
+
+	if (!cpu_exa->glyph_cache || op != PictOpOver || !maskFormat ||
+			maskFormat->format != PICT_a8)
+		return FALSE;
+
+	if (!pPixmap || pDst->alphaMap || !IsARGB32(pDst) ||
+			!OMAPPixmapBo(pPixmap) || !GetSolid(pSrc, &solid))
+		return FALSE;
+
+	GlyphExtents(nlist, list, glyphs, &extents);
+	if (extents.x1 >= extents.x2 || extents.y1 >= extents.y2)
+		return TRUE;
+
+	width = extents.x2 - extents.x1;
+	height = extents.y2 - extents.y1;
+	pitch = ALIGN(width, 16);
+	if (height > CPU_EXA_MAX_GLYPH_MASK / pitch)
+		return FALSE;
+
+	ValidatePicture(pDst);
+	extents.x1 += pDrawable->x;
+	extents.x2 += pDrawable->x;
+	extents.y1 += pDrawable->y;
+	extents.y2 += pDrawable->y;
+	RegionInit(&region, &extents, 1);
+	RegionIntersect(&region, &region, pDst->pCompositeClip);
+	if (!RegionNotEmpty(&region)) {
+		RegionUninit(&region);
+		return TRUE;
+	}
+
+	mask = calloc(height, pitch);
+	if (!mask)
+		goto fail;
+
+	if (!GlyphsToMask(cpu_exa, pDrawable->pScreen, mask, pitch,
+			extents.x1 - pDrawable->x, extents.y1 - pDrawable->y,
+			nlist, list, glyphs))
+		goto free_mask;
+
+	if (!PrepareOp(cpu_exa, NULL, NULL, pPixmap))
+		goto free_mask;
+
+	cpu_op = cpu_exa->op;
+	SetImage(&cpu_op->dst, pPixmap, pDst);
+	cpu_op->mask.ptr = mask;
+	cpu_op->mask.pitch = pitch;
+	cpu_op->mask.width = width;
+	cpu_op->mask.height = height;
+	cpu_op->mask.cpp = 1;
+	cpu_op->mask.format = PICT_a8;
+	cpu_op->has_mask = TRUE;
+	cpu_op->glyph_mask = mask;
+	cpu_op->parallel = TRUE;
+	cpu_op->op = op;
+	cpu_op->composite = COMPOSITE_OVER_SOLID_A8;
+	cpu_op->solid = solid;
+
+	ScreenToPixmap(pDrawable, pPixmap, &xoff, &yoff);
+
+	nbox = RegionNumRects(&region);
+	box = RegionRects(&region);
+	for (; nbox > 0; nbox--, box++) {
+		struct cpu_exa_job rect = {
+			.func = CompositeRect,
+			.mask_x = box->x1 - extents.x1,
+			.mask_y = box->y1 - extents.y1,
+			.dst_x = box->x1 + xoff,
+			.dst_y = box->y1 + yoff,
+			.width = box->x2 - box->x1,
+			.height = box->y2 - box->y1,
+		};
+
+		AddRect(cpu_exa, &rect);
+	}
+
+	Submit(cpu_exa);
+	RegionUninit(&region);
+	return TRUE;
+
+free_mask:
+	free(mask);
+fail:
+	RegionUninit(&region);
+	return FALSE;
+}
+
+static void
+Glyphs(CARD8 op, PicturePtr pSrc, PicturePtr pDst, PictFormatPtr maskFormat,
+		INT16 xSrc, INT16 ySrc, int nlist, GlyphListPtr list,
+		GlyphPtr *glyphs)
+{
+	ScreenPtr pScreen = pDst->pDrawable->pScreen;
+	PictureScreenPtr ps = GetPictureScreen(pScreen);
+	OMAPCpuEXAPtr cpu_exa = (OMAPCpuEXAPtr)OMAPEXAPTR(
+			xf86ScreenToScrn(pScreen));
+
+	if (GlyphsSolidA8(cpu_exa, op, pSrc, pDst, maskFormat, nlist, list,
+			glyphs))
+		return;
+
+	ps->Glyphs = cpu_exa->SavedGlyphs;
+	ps->Glyphs(op, pSrc, pDst, maskFormat, xSrc, ySrc, nlist, list,
+			glyphs);
+	cpu_exa->SavedGlyphs = ps->Glyphs;
+	ps->Glyphs = Glyphs;
+}
+
+/* Finish everything submitted, and stop the queue thread */
+static void
+StopQueue(OMAPCpuEXAPtr cpu_exa)
+{
+	if (!cpu_exa->threaded)
+		return;
+
+	pthread_mutex_lock(&cpu_exa->lock);
+	cpu_exa->quit = TRUE;
+	pthread_cond_broadcast(&cpu_exa->cond);
+	pthread_mutex_unlock(&cpu_exa->lock);
+
+	pthread_join(cpu_exa->thread, NULL);
+	cpu_exa->threaded = FALSE;
+	Retire(cpu_exa);
+}
+
+static Bool
+CloseScreen(CLOSE_SCREEN_ARGS_DECL)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPCpuEXAPtr cpu_exa = (OMAPCpuEXAPtr)OMAPEXAPTR(pScrn);
+
+	StopQueue(cpu_exa);
+	pthread_cond_destroy(&cpu_exa->cond);
+	pthread_mutex_destroy(&cpu_exa->lock);
+
+	omap_workers_free(cpu_exa->workers);
+	cpu_exa->workers = NULL;
+
+	/* Render's screen is gone by now, so there is no unwrapping Glyphs */
+	omap_glyph_cache_free(cpu_exa->glyph_cache);
+	cpu_exa->glyph_cache = NULL;
+	return TRUE;
+}
+
+static void
+FreeScreen(FREE_SCREEN_ARGS_DECL)
+{
+}
+
+
+OMAPEXAPtr
+InitCpuEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd)
+{
+	OMAPCpuEXAPtr cpu_exa;
+	OMAPEXAPtr omap_exa;
+	ExaDriverPtr exa;
+	PictureScreenPtr ps;
+	sigset_t all, old;
+	int ret;
+
+	INFO_MSG("CPU EXA mode");
+
+	cpu_exa = calloc(1, sizeof *cpu_exa);
+	omap_exa = (OMAPEXAPtr)cpu_exa;
+	if (!cpu_exa)
+		goto out;
+
+	exa = exaDriverAlloc();
+	if (!exa)
+		goto free_cpu_exa;
+
+	cpu_exa->exa = exa;
+
+	pthread_mutex_init(&cpu_exa->lock, NULL);
+	pthread_cond_init(&cpu_exa->cond, NULL);
+	cpu_exa->queue_tail = &cpu_exa->queue;
+
+	cpu_exa->workers = omap_workers_new();
+	if (cpu_exa->workers) {
+		INFO_MSG("CPU EXA using %d worker threads",
+				omap_workers_count(cpu_exa->workers));
+
+		/* Signals are the server thread's: keep them off the queue */
+		sigfillset(&all);
+		pthread_sigmask(SIG_BLOCK, &all, &old);
+		ret = pthread_create(&cpu_exa->thread, NULL, QueueThread,
+				cpu_exa);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		if (ret)
+			WARNING_MSG("Couldn't start CPU EXA queue thread, "
+					"operations will be synchronous");
+		else
+			cpu_exa->threaded = TRUE;
+	}
+
+	exa->exa_major = EXA_VERSION_MAJOR;
+	exa->exa_minor = EXA_VERSION_MINOR;
+
+	exa->pixmapOffsetAlign = 0;
+	exa->pixmapPitchAlign = 32;
+	exa->flags = EXA_OFFSCREEN_PIXMAPS |
+			EXA_HANDLES_PIXMAPS | EXA_SUPPORTS_PREPARE_AUX;
+	OMAPEXAMaxSize(pScrn, &exa->maxX, &exa->maxY);
+
+	/* Required EXA functions: */
+	exa->WaitMarker = WaitMarker;
+	exa->CreatePixmap2 = OMAPCreatePixmap;
+	exa->DestroyPixmap = OMAPDestroyPixmap;
+	exa->ModifyPixmapHeader = OMAPModifyPixmapHeader;
+
+	exa->PrepareAccess = PrepareAccess;
+	exa->FinishAccess = OMAPFinishAccess;
+	exa->PixmapIsOffscreen = OMAPPixmapIsOffscreen;
+
+	exa->UploadToScreen = OMAPUploadToScreen;
+	exa->DownloadFromScreen = OMAPDownloadFromScreen;
+
+	exa->MarkSync = MarkSync;
+
+	exa->PrepareSolid = PrepareSolid;
+	exa->Solid = Solid;
+	exa->DoneSolid = DoneSolid;
+
+	exa->PrepareCopy = PrepareCopy;
+	exa->Copy = Copy;
+	exa->DoneCopy = DoneCopy;
+
+	exa->CheckComposite = CheckComposite;
+	exa->PrepareComposite = PrepareComposite;
+	exa->Composite = Composite;
+	exa->DoneComposite = DoneComposite;
+
+	if (!exaDriverInit(pScreen, exa)) {
+		ERROR_MSG("exaDriverInit failed");
+		goto free_exa;
+	}
+
+	omap_exa->CloseScreen = CloseScreen;
+	omap_exa->FreeScreen = FreeScreen;
+	omap_exa->WaitBo = WaitBo;
+
+	/* Render's Glyphs is EXA's by now; wrap it */
+	ps = GetPictureScreenIfSet(pScreen);
+	if (ps) {
+		cpu_exa->glyph_cache = omap_glyph_cache_new(pScrn,
+				OMAPPTR(pScrn)->dev);
+		if (cpu_exa->glyph_cache) {
+			cpu_exa->SavedGlyphs = ps->Glyphs;
+			ps->Glyphs = Glyphs;
+		} else {
+			WARNING_MSG("Couldn't create glyph cache, "
+					"glyphs will be drawn by EXA");
+		}
+	}
+
+	return omap_exa;
+
+free_exa:
+	StopQueue(cpu_exa);
+	omap_workers_free(cpu_exa->workers);
+	pthread_cond_destroy(&cpu_exa->cond);
+	pthread_mutex_destroy(&cpu_exa->lock);
+	free(exa);
+free_cpu_exa:
+	free(cpu_exa);
+out:
+	return NULL;
+}
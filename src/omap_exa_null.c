@@ -119,8 +119,7 @@ InitNullEXA(ScreenPtr pScreen, ScrnInfoPtr pScrn, int fd)
 	exa->pixmapPitchAlign = 32;
 	exa->flags = EXA_OFFSCREEN_PIXMAPS |
 			EXA_HANDLES_PIXMAPS | EXA_SUPPORTS_PREPARE_AUX;
-	exa->maxX = 4096;
-	exa->maxY = 4096;
+	OMAPEXAMaxSize(pScrn, &exa->maxX, &exa->maxY);
 
 	/* Required EXA functions: */
 	exa->WaitMarker = OMAPWaitMarker;
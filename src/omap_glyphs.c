@@ -0,0 +1,324 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "omap_driver.h"
+#include "omap_glyphs.h"
+
+#include "picturestr.h"
+
+/* Pages are square, and the glyphs of a format get this many of them */
+#define GLYPH_PAGE_SIZE		1024
+#define GLYPH_MAX_PAGES		4
+/* Larger glyphs are not cached */
+#define GLYPH_MAX_SIZE		128
+/* Shelf heights are glyph heights rounded up to this */
+#define GLYPH_SHELF_ALIGN	4
+#define GLYPH_MAX_SHELVES	(GLYPH_PAGE_SIZE / GLYPH_SHELF_ALIGN)
+/* Formats with a set of pages */
+#define GLYPH_MAX_FORMATS	2
+
+struct glyph_shelf {
+	int y, height;
+	/* left edge of the free space */
+	int x;
+};
+
+/*
+ * The pages are only ever touched by the CPU, through the mapping, so no
+ * cache maintenance is done around them.
+ */
+struct glyph_page {
+	struct omap_bo *bo;
+	uint8_t *ptr;
+	int pitch;
+	/* changes whenever the page is emptied, which drops its glyphs */
+	unsigned int serial;
+	unsigned int last_used;
+	int nshelves;
+	struct glyph_shelf shelves[GLYPH_MAX_SHELVES];
+};
+
+struct glyph_atlas {
+	CARD32 format;
+	int cpp;
+	int npages;
+	struct glyph_page pages[GLYPH_MAX_PAGES];
+};
+
+struct omap_glyph_cache {
+	ScrnInfoPtr pScrn;
+	struct omap_device *dev;
+	unsigned int serial;
+	/* counts glyph strings, for finding the least recently used page */
+	unsigned int frame;
+	int natlases;
+	struct glyph_atlas atlases[GLYPH_MAX_FORMATS];
+};
+
+/* Where a glyph is in the cache; zeroed for new glyphs */
+struct glyph_entry {
+	struct omap_glyph_cache *cache;
+	struct glyph_page *page;
+	unsigned int serial;
+	int x, y;
+};
+
+static DevPrivateKeyRec glyph_key;
+
+static inline struct glyph_entry *
+glyph_entry(GlyphPtr glyph)
+{
+	return dixGetPrivateAddr(&glyph->devPrivates, &glyph_key);
+}
+
+struct omap_glyph_cache *
+omap_glyph_cache_new(ScrnInfoPtr pScrn, struct omap_device *dev)
+{
+	struct omap_glyph_cache *cache;
+
+	if (!dixRegisterPrivateKey(&glyph_key, PRIVATE_GLYPH,
+			sizeof(struct glyph_entry)))
+		return NULL;
+
+	cache = calloc(1, sizeof *cache);
+	if (!cache)
+		return NULL;
+
+	cache->pScrn = pScrn;
+	cache->dev = dev;
+	return cache;
+}
+
+void
+omap_glyph_cache_free(struct omap_glyph_cache *cache)
+{
+	int i, j;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < cache->natlases; i++) {
+		struct glyph_atlas *atlas = &cache->atlases[i];
+
+		for (j = 0; j < atlas->npages; j++)
+			omap_bo_unreference(atlas->pages[j].bo);
+	}
+	free(cache);
+}
+
+void
+omap_glyph_cache_begin(struct omap_glyph_cache *cache)
+{
+	cache->frame++;
+}
+
+static struct glyph_atlas *
+get_atlas(struct omap_glyph_cache *cache, CARD32 format)
+{
+	struct glyph_atlas *atlas;
+	int i;
+
+	for (i = 0; i < cache->natlases; i++)
+		if (cache->atlases[i].format == format)
+			return &cache->atlases[i];
+
+	if (cache->natlases == GLYPH_MAX_FORMATS)
+		return NULL;
+
+	atlas = &cache->atlases[cache->natlases++];
+	atlas->format = format;
+	atlas->cpp = PICT_FORMAT_BPP(format) / 8;
+	return atlas;
+}
+
+const uint8_t *
+omap_glyph_cache_find(struct omap_glyph_cache *cache, GlyphPtr glyph,
+		CARD32 format, int *pitch)
+{
+	struct glyph_entry *entry = glyph_entry(glyph);
+	struct glyph_page *page = entry->page;
+	struct glyph_atlas *atlas;
+
+	if (entry->cache != cache || !page || entry->serial != page->serial)
+		return NULL;
+
+	/* a glyph only comes in the format of its glyph set */
+	atlas = get_atlas(cache, format);
+	if (!atlas || page < atlas->pages ||
+			page >= atlas->pages + atlas->npages)
+		return NULL;
+
+	page->last_used = cache->frame;
+	*pitch = page->pitch;
+	return page->ptr + entry->y * page->pitch + entry->x * atlas->cpp;
+}
+
+static void
+empty_page(struct omap_glyph_cache *cache, struct glyph_page *page)
+{
+	page->serial = ++cache->serial;
+	/* zero is what new glyphs have */
+	if (!page->serial)
+		page->serial = ++cache->serial;
+	page->nshelves = 0;
+}
+
+static struct glyph_page *
+new_page(struct omap_glyph_cache *cache, struct glyph_atlas *atlas)
+{
+	ScrnInfoPtr pScrn = cache->pScrn;
+	struct glyph_page *page = &atlas->pages[atlas->npages];
+	struct omap_bo *bo;
+
+	bo = omap_bo_new_with_depth(cache->dev, GLYPH_PAGE_SIZE,
+			GLYPH_PAGE_SIZE, PICT_FORMAT_DEPTH(atlas->format),
+			PICT_FORMAT_BPP(atlas->format));
+	if (!bo) {
+		ERROR_MSG("failed to allocate glyph cache page");
+		return NULL;
+	}
+
+	page->ptr = omap_bo_map(bo);
+	if (!page->ptr) {
+		ERROR_MSG("failed to map glyph cache page");
+		omap_bo_unreference(bo);
+		return NULL;
+	}
+
+	page->bo = bo;
+	page->pitch = omap_bo_pitch(bo);
+	empty_page(cache, page);
+	atlas->npages++;
+	return page;
+}
+
+/* Find room for a @width x @height glyph on @page */
+static Bool
+page_alloc(struct glyph_page *page, int width, int height, int *x, int *y)
+{
+	struct glyph_shelf *shelf;
+	int shelf_height = ALIGN(height, GLYPH_SHELF_ALIGN);
+	int i, top = 0;
+
+	for (i = 0; i < page->nshelves; i++) {
+		shelf = &page->shelves[i];
+		if (shelf->height == shelf_height &&
+				shelf->x + width <= GLYPH_PAGE_SIZE)
+			goto found;
+		top = shelf->y + shelf->height;
+	}
+
+	if (page->nshelves == GLYPH_MAX_SHELVES ||
+			top + shelf_height > GLYPH_PAGE_SIZE)
+		return FALSE;
+
+	shelf = &page->shelves[page->nshelves++];
+	shelf->y = top;
+	shelf->height = shelf_height;
+	shelf->x = 0;
+
+found:
+	*x = shelf->x;
+	*y = shelf->y;
+	shelf->x += width;
+	return TRUE;
+}
+
+/* Find room for a @width x @height glyph, making some if need be */
+static struct glyph_page *
+atlas_alloc(struct omap_glyph_cache *cache, struct glyph_atlas *atlas,
+		int width, int height, int *x, int *y)
+{
+	struct glyph_page *page, *lru = NULL;
+	int i;
+
+	for (i = 0; i < atlas->npages; i++) {
+		page = &atlas->pages[i];
+		if (page_alloc(page, width, height, x, y))
+			return page;
+		if (!lru || (int)(page->last_used - lru->last_used) < 0)
+			lru = page;
+	}
+
+	if (atlas->npages < GLYPH_MAX_PAGES) {
+		page = new_page(cache, atlas);
+		if (page && page_alloc(page, width, height, x, y))
+			return page;
+	}
+
+	/* Glyphs of the current string may be on this page too, but they
+	 * have been drawn from already.
+	 */
+	if (!lru)
+		return NULL;
+	empty_page(cache, lru);
+	if (!page_alloc(lru, width, height, x, y))
+		return NULL;
+	return lru;
+}
+
+const uint8_t *
+omap_glyph_cache_add(struct omap_glyph_cache *cache, GlyphPtr glyph,
+		CARD32 format, const uint8_t *bits, int bits_pitch, int *pitch)
+{
+	struct glyph_entry *entry = glyph_entry(glyph);
+	int width = glyph->info.width, height = glyph->info.height;
+	struct glyph_atlas *atlas;
+	struct glyph_page *page;
+	uint8_t *ptr;
+	int x, y, i;
+
+	if (width > GLYPH_MAX_SIZE || height > GLYPH_MAX_SIZE)
+		return NULL;
+
+	atlas = get_atlas(cache, format);
+	if (!atlas)
+		return NULL;
+
+	page = atlas_alloc(cache, atlas, width, height, &x, &y);
+	if (!page)
+		return NULL;
+
+	ptr = page->ptr + y * page->pitch + x * atlas->cpp;
+	for (i = 0; i < height; i++)
+		memcpy(ptr + i * page->pitch, bits + i * bits_pitch,
+				width * atlas->cpp);
+
+	entry->cache = cache;
+	entry->page = page;
+	entry->serial = page->serial;
+	entry->x = x;
+	entry->y = y;
+
+	page->last_used = cache->frame;
+	*pitch = page->pitch;
+	return ptr;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_GLYPHS_H_
+#define OMAP_GLYPHS_H_
+
+#include <stdint.h>
+
+#include <xf86.h>
+#include "glyphstr.h"
+
+#include "omap_dumb.h"
+
+/*
+ * A cache of glyph images, packed into a few large bos for each format.
+ * Each page is split into shelves of glyphs of about the same height; when
+ * the pages of a format are full, the least recently used one is emptied.
+ */
+struct omap_glyph_cache;
+
+struct omap_glyph_cache *omap_glyph_cache_new(ScrnInfoPtr pScrn,
+		struct omap_device *dev);
+void omap_glyph_cache_free(struct omap_glyph_cache *cache);
+
+/* Start on a glyph string: pages it uses become the most recently used */
+void omap_glyph_cache_begin(struct omap_glyph_cache *cache);
+
+/*
+ * The image of @glyph in @format, if it is in the cache, else NULL.  It
+ * stays valid until the next omap_glyph_cache_add().
+ */
+const uint8_t *omap_glyph_cache_find(struct omap_glyph_cache *cache,
+		GlyphPtr glyph, CARD32 format, int *pitch);
+
+/*
+ * Copy the image of @glyph in @format from @bits into the cache, and return
+ * where it went; NULL if it doesn't fit in a page or there is no memory.
+ */
+const uint8_t *omap_glyph_cache_add(struct omap_glyph_cache *cache,
+		GlyphPtr glyph, CARD32 format, const uint8_t *bits,
+		int bits_pitch, int *pitch);
+
+#endif /* OMAP_GLYPHS_H_ */
@@ -0,0 +1,364 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "omap_driver.h"
+#include "omap_copy.h"
+#include "omap_crc.h"
+
+/*
+ * Copying the shadow framebuffer to the root scanout.
+ *
+ * On multi-core systems the copy is done by a worker thread, so that it
+ * overlaps with processing the next batch of requests.  The block handler
+ * hands the worker a snapshot of the damage; the server thread only waits
+ * for it when it is about to draw over that snapshot again, or needs the
+ * scanout contents itself.
+ */
+
+struct omap_shadow {
+	ScrnInfoPtr pScrn;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* protected by lock: */
+	Bool pending;	/* the worker has a copy to do */
+	Bool quit;
+
+	/*
+	 * Only touched by the server thread, apart from the worker reading
+	 * the copy parameters while pending.  busy stays set until the
+	 * server thread has waited for the copy.
+	 */
+	Bool busy;
+	RegionRec region;
+	/* what the worker reads: region, rounded out to whole tiles when it
+	 * checksums them
+	 */
+	RegionRec read;
+	struct omap_bo *bo;
+	struct omap_crc_tiles *tiles;
+	uint8_t *dst;
+	const uint8_t *src;
+
+	/** Reports root pixmap rendering before it happens. */
+	DamagePtr damage;
+};
+
+static void
+shadow_copy(struct omap_bo *bo, struct omap_crc_tiles *tiles, uint8_t *dst,
+		const uint8_t *src, RegionPtr pRegion)
+{
+	int pitch = omap_bo_pitch(bo);
+	int cpp = omap_bo_Bpp(bo);
+	BoxPtr pBox = RegionRects(pRegion);
+	int i, n = RegionNumRects(pRegion);
+
+	/* Nothing but the flush writes to the root scanout, so its tile
+	 * checksums stay valid.
+	 */
+	if (tiles) {
+		omap_crc_tiles_copy(tiles, dst, pitch, src, pitch, cpp,
+				0, 0, pRegion);
+		return;
+	}
+
+	for (i = 0; i < n; i++, pBox++) {
+		/* damage from before a resize may lie outside the new size */
+		int x1 = max(pBox->x1, 0);
+		int y1 = max(pBox->y1, 0);
+		int x2 = min(pBox->x2, (int)omap_bo_width(bo));
+		int y2 = min(pBox->y2, (int)omap_bo_height(bo));
+		int offset = y1 * pitch + x1 * cpp;
+
+		omap_copy_rect(dst + offset, pitch, src + offset, pitch,
+				(x2 - x1) * cpp, y2 - y1);
+	}
+}
+
+static void *shadow_worker(void *arg)
+{
+	struct omap_shadow *shadow = arg;
+
+	pthread_mutex_lock(&shadow->lock);
+	for (;;) {
+		while (!shadow->pending && !shadow->quit)
+			pthread_cond_wait(&shadow->cond, &shadow->lock);
+		if (shadow->quit)
+			break;
+		pthread_mutex_unlock(&shadow->lock);
+
+		shadow_copy(shadow->bo, shadow->tiles, shadow->dst,
+				shadow->src, &shadow->region);
+
+		pthread_mutex_lock(&shadow->lock);
+		shadow->pending = FALSE;
+		pthread_cond_broadcast(&shadow->cond);
+	}
+	pthread_mutex_unlock(&shadow->lock);
+
+	return NULL;
+}
+
+/*
+ * The tiles covering @pRegion, into @out.  The worker checksums all of a
+ * tile it copies part of, so rendering anywhere in it has to wait: else the
+ * checksum could take in pixels that were never copied, and the tile would
+ * be skipped as unchanged on the next flush.
+ */
+static Bool
+shadow_tile_region(RegionPtr out, RegionPtr pRegion)
+{
+	BoxPtr pBox = RegionRects(pRegion);
+	int i, n = RegionNumRects(pRegion);
+	const int mask = OMAP_CRC_TILE_SIZE - 1;
+
+	RegionEmpty(out);
+	for (i = 0; i < n; i++) {
+		RegionRec tiles;
+		BoxRec box;
+		Bool ret;
+
+		box.x1 = pBox[i].x1 & ~mask;
+		box.y1 = pBox[i].y1 & ~mask;
+		box.x2 = (pBox[i].x2 + mask) & ~mask;
+		box.y2 = (pBox[i].y2 + mask) & ~mask;
+		RegionInit(&tiles, &box, 1);
+		ret = RegionUnion(out, out, &tiles);
+		RegionUninit(&tiles);
+		if (!ret)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Rendering to the root pixmap is about to touch @pRegion; if that overlaps
+ * what the copy in flight reads, let the copy finish first.
+ */
+static void
+shadow_damage_report(DamagePtr pDamage, RegionPtr pRegion, void *closure)
+{
+	struct omap_shadow *shadow = closure;
+	BoxPtr pBox;
+	int i, n;
+
+	if (!shadow->busy)
+		return;
+
+	n = RegionNumRects(pRegion);
+	pBox = RegionRects(pRegion);
+	for (i = 0; i < n; i++) {
+		if (RegionContainsRect(&shadow->read, &pBox[i]) != rgnOUT) {
+			OMAPShadowWait(shadow->pScrn);
+			return;
+		}
+	}
+}
+
+/**
+ * Start the shadow flush worker, if there is a spare core for it to run on.
+ * Without it, OMAPShadowFlush() copies synchronously.
+ */
+Bool
+OMAPShadowInit(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_shadow *shadow;
+	PixmapPtr rootPixmap;
+	sigset_t all, old;
+	int ret;
+
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+		return FALSE;
+
+	shadow = calloc(1, sizeof *shadow);
+	if (!shadow)
+		return FALSE;
+
+	shadow->pScrn = pScrn;
+	RegionNull(&shadow->region);
+	RegionNull(&shadow->read);
+	pthread_mutex_init(&shadow->lock, NULL);
+	pthread_cond_init(&shadow->cond, NULL);
+
+	shadow->damage = DamageCreate(shadow_damage_report, NULL,
+			DamageReportRawRegion, TRUE, pScreen, shadow);
+	if (!shadow->damage)
+		goto fail;
+
+	/* The server's signals, SIGIO input in particular, are for its own
+	 * thread: the worker inherits a mask that blocks them all.
+	 */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	ret = pthread_create(&shadow->thread, NULL, shadow_worker, shadow);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret) {
+		DamageDestroy(shadow->damage);
+		goto fail;
+	}
+
+	rootPixmap = pScreen->GetScreenPixmap(pScreen);
+	DamageRegister(&rootPixmap->drawable, shadow->damage);
+
+	pOMAP->shadow_flush = shadow;
+	INFO_MSG("ShadowFB flushing from a worker thread");
+	return TRUE;
+
+fail:
+	pthread_cond_destroy(&shadow->cond);
+	pthread_mutex_destroy(&shadow->lock);
+	free(shadow);
+	return FALSE;
+}
+
+void
+OMAPShadowFini(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_shadow *shadow = pOMAP->shadow_flush;
+	PixmapPtr rootPixmap;
+
+	if (!shadow)
+		return;
+
+	OMAPShadowWait(pScrn);
+
+	pthread_mutex_lock(&shadow->lock);
+	shadow->quit = TRUE;
+	pthread_cond_broadcast(&shadow->cond);
+	pthread_mutex_unlock(&shadow->lock);
+	pthread_join(shadow->thread, NULL);
+
+	rootPixmap = pScreen->GetScreenPixmap(pScreen);
+	DamageUnregister(&rootPixmap->drawable, shadow->damage);
+	DamageDestroy(shadow->damage);
+
+	RegionUninit(&shadow->region);
+	RegionUninit(&shadow->read);
+	pthread_cond_destroy(&shadow->cond);
+	pthread_mutex_destroy(&shadow->lock);
+	free(shadow);
+	pOMAP->shadow_flush = NULL;
+}
+
+/**
+ * Wait for the shadow copy in flight, if any, to land in the root scanout.
+ * Anything reading the root scanout, or replacing it or the shadow, must
+ * call this first.
+ */
+void
+OMAPShadowWait(ScrnInfoPtr pScrn)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_shadow *shadow = pOMAP->shadow_flush;
+
+	if (!shadow || !shadow->busy)
+		return;
+
+	pthread_mutex_lock(&shadow->lock);
+	while (shadow->pending)
+		pthread_cond_wait(&shadow->cond, &shadow->lock);
+	pthread_mutex_unlock(&shadow->lock);
+
+	omap_bo_cpu_fini(shadow->bo, 0);
+	omap_bo_unreference(shadow->bo);
+	shadow->bo = NULL;
+	shadow->tiles = NULL;
+	RegionEmpty(&shadow->region);
+	RegionEmpty(&shadow->read);
+	shadow->busy = FALSE;
+}
+
+/**
+ * Copy the parts of the shadow framebuffer in @pRegion to the root scanout.
+ * With the worker running, this only starts the copy.
+ */
+void
+OMAPShadowFlush(ScrnInfoPtr pScrn, RegionPtr pRegion)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_shadow *shadow = pOMAP->shadow_flush;
+	struct omap_bo *bo = pOMAP->scanout;
+	struct omap_crc_tiles *tiles;
+	struct omap_bo_range range;
+	BoxPtr pExtents;
+	uint8_t *dst;
+
+	OMAPShadowWait(pScrn);
+
+	if (!RegionNotEmpty(pRegion))
+		return;
+
+	pExtents = RegionExtents(pRegion);
+	omap_bo_box_range(bo, pExtents->x1, pExtents->y1,
+			pExtents->x2, pExtents->y2, &range);
+
+	dst = omap_bo_map(bo);
+	if (!dst || omap_bo_cpu_prep_range(bo, OMAP_GEM_WRITE, &range)) {
+		ERROR_MSG("Unable to access root scanout for shadow flush");
+		return;
+	}
+
+	/* may fail, in which case everything damaged is copied */
+	tiles = omap_bo_crc_tiles(bo);
+
+	if (!shadow) {
+		shadow_copy(bo, tiles, dst, pOMAP->shadow, pRegion);
+		omap_bo_cpu_fini(bo, 0);
+		return;
+	}
+
+	if (!RegionCopy(&shadow->region, pRegion) ||
+			!(tiles ? shadow_tile_region(&shadow->read, pRegion) :
+				RegionCopy(&shadow->read, pRegion))) {
+		/* copy it ourselves rather than lose it */
+		shadow_copy(bo, tiles, dst, pOMAP->shadow, pRegion);
+		omap_bo_cpu_fini(bo, 0);
+		return;
+	}
+
+	omap_bo_reference(bo);
+	shadow->bo = bo;
+	shadow->tiles = tiles;
+	shadow->dst = dst;
+	shadow->src = pOMAP->shadow;
+	shadow->busy = TRUE;
+
+	pthread_mutex_lock(&shadow->lock);
+	shadow->pending = TRUE;
+	pthread_cond_signal(&shadow->cond);
+	pthread_mutex_unlock(&shadow->lock);
+}
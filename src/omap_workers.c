@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "omap_workers.h"
+
+#define MAX_WORKERS	8
+#define QUEUE_SIZE	128
+
+struct omap_work {
+	omap_work_func func;
+	void *data;
+};
+
+struct omap_workers {
+	int nthreads;
+	pthread_t threads[MAX_WORKERS];
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* work queued, or quit */
+	pthread_cond_t done_cond;	/* work taken off the queue or finished */
+	/* protected by lock: */
+	struct omap_work queue[QUEUE_SIZE];
+	int head, queued;
+	int running;
+	int quit;
+};
+
+static void *
+worker_main(void *arg)
+{
+	struct omap_workers *workers = arg;
+
+	pthread_mutex_lock(&workers->lock);
+	for (;;) {
+		struct omap_work work;
+
+		while (!workers->queued && !workers->quit)
+			pthread_cond_wait(&workers->work_cond, &workers->lock);
+		if (!workers->queued)
+			break;
+
+		work = workers->queue[workers->head];
+		workers->head = (workers->head + 1) % QUEUE_SIZE;
+		workers->queued--;
+		workers->running++;
+		pthread_mutex_unlock(&workers->lock);
+
+		work.func(work.data);
+
+		pthread_mutex_lock(&workers->lock);
+		workers->running--;
+		pthread_cond_broadcast(&workers->done_cond);
+	}
+	pthread_mutex_unlock(&workers->lock);
+	return NULL;
+}
+
+struct omap_workers *
+omap_workers_new(void)
+{
+	struct omap_workers *workers;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	sigset_t all, old;
+	int i;
+
+	if (ncpus < 2)
+		return NULL;
+
+	workers = calloc(1, sizeof *workers);
+	if (!workers)
+		return NULL;
+
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_cond_init(&workers->work_cond, NULL);
+	pthread_cond_init(&workers->done_cond, NULL);
+
+	/* Signals are the server thread's: keep them all off the workers */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (i = 0; i < ncpus - 1 && i < MAX_WORKERS; i++) {
+		if (pthread_create(&workers->threads[i], NULL, worker_main,
+				workers))
+			break;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	workers->nthreads = i;
+
+	if (!workers->nthreads) {
+		omap_workers_free(workers);
+		return NULL;
+	}
+	return workers;
+}
+
+void
+omap_workers_free(struct omap_workers *workers)
+{
+	int i;
+
+	if (!workers)
+		return;
+
+	pthread_mutex_lock(&workers->lock);
+	workers->quit = 1;
+	pthread_cond_broadcast(&workers->work_cond);
+	pthread_mutex_unlock(&workers->lock);
+
+	/* workers drain the queue before they quit */
+	for (i = 0; i < workers->nthreads; i++)
+		pthread_join(workers->threads[i], NULL);
+
+	pthread_cond_destroy(&workers->done_cond);
+	pthread_cond_destroy(&workers->work_cond);
+	pthread_mutex_destroy(&workers->lock);
+	free(workers);
+}
+
+int
+omap_workers_count(const struct omap_workers *workers)
+{
+	return workers ? workers->nthreads : 0;
+}
+
+void
+omap_workers_queue(struct omap_workers *workers, omap_work_func func,
+		void *data)
+{
+	struct omap_work *work;
+
+	pthread_mutex_lock(&workers->lock);
+	while (workers->queued == QUEUE_SIZE)
+		pthread_cond_wait(&workers->done_cond, &workers->lock);
+
+	work = &workers->queue[(workers->head + workers->queued) % QUEUE_SIZE];
+	work->func = func;
+	work->data = data;
+	workers->queued++;
+	pthread_cond_signal(&workers->work_cond);
+	pthread_mutex_unlock(&workers->lock);
+}
+
+void
+omap_workers_wait(struct omap_workers *workers)
+{
+	pthread_mutex_lock(&workers->lock);
+	while (workers->queued || workers->running)
+		pthread_cond_wait(&workers->done_cond, &workers->lock);
+	pthread_mutex_unlock(&workers->lock);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_WORKERS_H_
+#define OMAP_WORKERS_H_
+
+/*
+ * A pool of worker threads, one per online CPU besides the one running the
+ * server, for splitting up large pixel operations.
+ */
+struct omap_workers;
+
+typedef void (*omap_work_func)(void *data);
+
+/* Returns NULL on single-core systems, where there is nothing to gain */
+struct omap_workers *omap_workers_new(void);
+void omap_workers_free(struct omap_workers *workers);
+
+/* Number of worker threads, not counting the caller */
+int omap_workers_count(const struct omap_workers *workers);
+
+/* Run @func(@data) on a worker; blocks while the queue is full */
+void omap_workers_queue(struct omap_workers *workers, omap_work_func func,
+		void *data);
+
+/* Wait until everything queued so far has run */
+void omap_workers_wait(struct omap_workers *workers);
+
+#endif /* OMAP_WORKERS_H_ */
@@ -0,0 +1,724 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "omap_driver.h"
+#include "omap_copy.h"
+#include "omap_exa.h"
+#include "omap_workers.h"
+#include "omap_yuv.h"
+
+#include "xf86xv.h"
+#include "fourcc.h"
+#include "xf86drmMode.h"
+#include "drm_fourcc.h"
+#include "damage.h"
+
+#ifndef DRM_PLANE_TYPE_OVERLAY
+#define DRM_PLANE_TYPE_OVERLAY	0
+#endif
+
+#define FOURCC_NV12	0x3231564e
+#define XVIMAGE_NV12 \
+	{ \
+		FOURCC_NV12, XvYUV, LSBFirst, \
+		{ 'N', 'V', '1', '2', 0x00, 0x00, 0x00, 0x10, \
+		  0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 }, \
+		12, XvPlanar, 2, 0, 0, 0, 0, 8, 8, 8, 1, 2, 2, 1, 2, 2, \
+		{ 'Y', 'U', 'V', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, \
+		  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, \
+		XvTopToBottom \
+	}
+
+#define VIDEO_MAX_SIZE		4096
+/* The plane scans out of one while the next frame goes into the other */
+#define VIDEO_BOS		2
+/* Ports converting on the CPU, for when there are no planes to spare */
+#define VIDEO_CPU_PORTS		2
+
+/*
+ * An Xv port, showing video through one overlay plane, which does the
+ * scaling and colour conversion.  @crtc is the crtc the plane is on, or NULL
+ * when it is off.  Ports without a plane, and frames the plane can't show,
+ * are converted on the CPU into the window instead.
+ */
+struct omap_video_port {
+	uint32_t plane_id;
+	uint32_t possible_crtcs;
+	Bool nv12;
+	Bool yuv420;
+	Bool yuyv;
+	xf86CrtcPtr crtc;
+	struct omap_bo *bo[VIDEO_BOS];
+	int back;
+	unsigned short width;
+	unsigned short height;
+	uint32_t format;
+};
+
+struct omap_video {
+	XF86VideoAdaptorPtr adaptor;
+	struct omap_video_port *ports;
+	int nports;
+	struct omap_workers *workers;
+};
+
+static XF86VideoEncodingRec Encodings[] = {
+	{ 0, "XV_IMAGE", VIDEO_MAX_SIZE, VIDEO_MAX_SIZE, { 1, 1 } },
+};
+
+static XF86VideoFormatRec Formats[] = {
+	{ 16, TrueColor },
+	{ 24, TrueColor },
+};
+
+static XF86ImageRec Images[] = {
+	XVIMAGE_I420,
+	XVIMAGE_YV12,
+	XVIMAGE_NV12,
+	XVIMAGE_YUY2,
+};
+
+static void
+FreeBos(struct omap_video_port *port)
+{
+	int i;
+
+	for (i = 0; i < VIDEO_BOS; i++) {
+		omap_bo_unreference(port->bo[i]);
+		port->bo[i] = NULL;
+	}
+	port->width = 0;
+	port->height = 0;
+	port->format = 0;
+}
+
+static void
+StopVideo(ScrnInfoPtr pScrn, pointer data, Bool shutdown)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_video_port *port = data;
+
+	if (port->crtc && drmModeSetPlane(pOMAP->drmFD, port->plane_id, 0, 0,
+			0, 0, 0, 0, 0, 0, 0, 0, 0))
+		ERROR_MSG("[PLANE:%u] disable failed: %s", port->plane_id,
+				strerror(errno));
+	port->crtc = NULL;
+
+	if (shutdown)
+		FreeBos(port);
+}
+
+static int
+SetPortAttribute(ScrnInfoPtr pScrn, Atom attribute, INT32 value,
+		pointer data)
+{
+	return BadMatch;
+}
+
+static int
+GetPortAttribute(ScrnInfoPtr pScrn, Atom attribute, INT32 *value,
+		pointer data)
+{
+	return BadMatch;
+}
+
+static void
+QueryBestSize(ScrnInfoPtr pScrn, Bool motion, short vid_w, short vid_h,
+		short drw_w, short drw_h, unsigned int *p_w, unsigned int *p_h,
+		pointer data)
+{
+	/* the plane, or the CPU, scales to anything */
+	*p_w = drw_w;
+	*p_h = drw_h;
+}
+
+static int
+QueryImageAttributes(ScrnInfoPtr pScrn, int id, unsigned short *w,
+		unsigned short *h, int *pitches, int *offsets)
+{
+	int size, tmp;
+
+	*w = min(*w, VIDEO_MAX_SIZE);
+	*h = min(*h, VIDEO_MAX_SIZE);
+	*w = (*w + 1) & ~1;
+	*h = (*h + 1) & ~1;
+
+	if (id == FOURCC_YUY2) {
+		size = *w * 2;
+		if (pitches)
+			pitches[0] = size;
+		if (offsets)
+			offsets[0] = 0;
+		return size * *h;
+	}
+
+	size = (*w + 3) & ~3;
+	if (pitches)
+		pitches[0] = size;
+	if (offsets)
+		offsets[0] = 0;
+	size *= *h;
+	if (offsets)
+		offsets[1] = size;
+
+	switch (id) {
+	case FOURCC_NV12:
+		tmp = (*w + 3) & ~3;
+		if (pitches)
+			pitches[1] = tmp;
+		size += tmp * (*h / 2);
+		break;
+	case FOURCC_I420:
+	case FOURCC_YV12:
+	default:
+		tmp = (*w / 2 + 3) & ~3;
+		if (pitches)
+			pitches[1] = pitches[2] = tmp;
+		tmp *= *h / 2;
+		size += tmp;
+		if (offsets)
+			offsets[2] = size;
+		size += tmp;
+		break;
+	}
+
+	return size;
+}
+
+/* The enabled crtc the plane can go on showing most of @box */
+static xf86CrtcPtr
+BestCrtc(ScrnInfoPtr pScrn, struct omap_video_port *port, BoxPtr box)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	xf86CrtcPtr best = NULL;
+	long best_area = 0;
+	int i;
+
+	for (i = 0; i < xf86_config->num_crtc; i++) {
+		xf86CrtcPtr crtc = xf86_config->crtc[i];
+		long area;
+		int w, h;
+
+		if (!(port->possible_crtcs & (1 << i)) || !crtc->enabled)
+			continue;
+
+		w = min(box->x2, crtc->x + crtc->mode.HDisplay) -
+				max(box->x1, crtc->x);
+		h = min(box->y2, crtc->y + crtc->mode.VDisplay) -
+				max(box->y1, crtc->y);
+		if (w <= 0 || h <= 0)
+			continue;
+
+		area = (long)w * h;
+		if (area > best_area) {
+			best = crtc;
+			best_area = area;
+		}
+	}
+
+	return best;
+}
+
+static Bool
+AllocBos(ScrnInfoPtr pScrn, struct omap_video_port *port,
+		unsigned short width, unsigned short height, uint32_t format)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	int i;
+
+	if (port->bo[0] && port->width == width && port->height == height &&
+			port->format == format)
+		return TRUE;
+
+	FreeBos(port);
+	for (i = 0; i < VIDEO_BOS; i++) {
+		port->bo[i] = omap_bo_new_with_format(pOMAP->dev, width,
+				height, format, 8);
+		if (!port->bo[i]) {
+			FreeBos(port);
+			return FALSE;
+		}
+	}
+	port->width = width;
+	port->height = height;
+	port->format = format;
+	return TRUE;
+}
+
+/*
+ * Copy the @id image in @buf to @bo, which has the @format planes.  Only the
+ * chroma of planar images may need (de)interleaving on the way, for planes
+ * that can't do the client's layout.
+ */
+static Bool
+CopyImage(struct omap_bo *bo, uint32_t format, int id,
+		const unsigned char *buf, unsigned short width,
+		unsigned short height)
+{
+	int pitches[3], offsets[3];
+	unsigned short w = width, h = height;
+	int cw = (width + 1) / 2, ch = (height + 1) / 2;
+	const uint8_t *src_u, *src_v;
+	uint8_t *dst;
+	int x, y;
+
+	QueryImageAttributes(NULL, id, &w, &h, pitches, offsets);
+
+	dst = omap_bo_map(bo);
+	if (!dst || omap_bo_cpu_prep(bo, OMAP_GEM_WRITE))
+		return FALSE;
+
+	omap_stream_rect(dst, omap_bo_pitch(bo), buf, pitches[0],
+			id == FOURCC_YUY2 ? width * 2 : width, height);
+
+	if (id == FOURCC_YUY2) {
+		/* packed, all done */
+	} else if (id == FOURCC_NV12 && format == DRM_FORMAT_NV12) {
+		omap_stream_rect(dst + omap_bo_plane_offset(bo, 1),
+				omap_bo_plane_pitch(bo, 1), buf + offsets[1],
+				pitches[1], cw * 2, ch);
+	} else if (id == FOURCC_NV12) {
+		const uint8_t *uv = buf + offsets[1];
+		uint8_t *u = dst + omap_bo_plane_offset(bo, 1);
+		uint8_t *v = dst + omap_bo_plane_offset(bo, 2);
+
+		for (y = 0; y < ch; y++) {
+			for (x = 0; x < cw; x++) {
+				u[x] = uv[2 * x];
+				v[x] = uv[2 * x + 1];
+			}
+			uv += pitches[1];
+			u += omap_bo_plane_pitch(bo, 1);
+			v += omap_bo_plane_pitch(bo, 2);
+		}
+	} else {
+		src_u = buf + offsets[id == FOURCC_YV12 ? 2 : 1];
+		src_v = buf + offsets[id == FOURCC_YV12 ? 1 : 2];
+
+		if (format == DRM_FORMAT_YUV420) {
+			omap_stream_rect(dst + omap_bo_plane_offset(bo, 1),
+					omap_bo_plane_pitch(bo, 1), src_u,
+					pitches[1], cw, ch);
+			omap_stream_rect(dst + omap_bo_plane_offset(bo, 2),
+					omap_bo_plane_pitch(bo, 2), src_v,
+					pitches[2], cw, ch);
+		} else {
+			uint8_t *uv = dst + omap_bo_plane_offset(bo, 1);
+
+			for (y = 0; y < ch; y++) {
+				uint16_t *d = (uint16_t *)uv;
+
+				/* little endian: U in the low byte */
+				for (x = 0; x < cw; x++)
+					d[x] = src_u[x] | src_v[x] << 8;
+				src_u += pitches[1];
+				src_v += pitches[2];
+				uv += omap_bo_plane_pitch(bo, 1);
+			}
+		}
+	}
+
+	omap_bo_cpu_fini(bo, OMAP_GEM_WRITE);
+	return TRUE;
+}
+
+/* The format @port's plane shows @id in, or 0 if it can't */
+static uint32_t
+PlaneFormat(struct omap_video_port *port, int id)
+{
+	switch (id) {
+	case FOURCC_YUY2:
+		return port->yuyv ? DRM_FORMAT_YUYV : 0;
+	case FOURCC_NV12:
+		if (port->nv12)
+			return DRM_FORMAT_NV12;
+		return port->yuv420 ? DRM_FORMAT_YUV420 : 0;
+	default:
+		if (port->yuv420)
+			return DRM_FORMAT_YUV420;
+		return port->nv12 ? DRM_FORMAT_NV12 : 0;
+	}
+}
+
+/*
+ * Convert and scale the frame into the window's pixmap, clip box by clip
+ * box, each split into bands of rows over the worker threads.
+ */
+static int
+PutImageCPU(ScrnInfoPtr pScrn, short src_x, short src_y, short drw_x,
+		short drw_y, short src_w, short src_h, short drw_w, short drw_h,
+		int id, unsigned char *buf, short width, short height,
+		RegionPtr clipBoxes, DrawablePtr pDraw)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	ScreenPtr pScreen = pDraw->pScreen;
+	BoxPtr pBox = RegionRects(clipBoxes);
+	int nBox = RegionNumRects(clipBoxes);
+	unsigned short w = width, h = height;
+	int pitches[3], offsets[3];
+	int xoff = 0, yoff = 0, ret = Success;
+	struct omap_yuv_image image;
+	struct omap_yuv_scale scale;
+	PixmapPtr pPixmap;
+	struct omap_bo *bo;
+	BoxRec box;
+
+	if (pDraw->type != DRAWABLE_WINDOW)
+		return BadMatch;
+	if (drw_w <= 0 || drw_h <= 0)
+		return Success;
+
+	pPixmap = pScreen->GetWindowPixmap((WindowPtr)pDraw);
+	if (pPixmap->drawable.bitsPerPixel != 32)
+		return BadMatch;
+#ifdef COMPOSITE
+	/* redirected windows have pixmaps of their own */
+	xoff = -pPixmap->screen_x;
+	yoff = -pPixmap->screen_y;
+#endif
+
+	QueryImageAttributes(pScrn, id, &w, &h, pitches, offsets);
+	image.width = width;
+	image.height = height;
+	image.planes[0] = buf;
+	image.pitches[0] = pitches[0];
+	switch (id) {
+	case FOURCC_YUY2:
+		image.format = OMAP_YUV_YUYV;
+		break;
+	case FOURCC_NV12:
+		image.format = OMAP_YUV_NV12;
+		image.planes[1] = buf + offsets[1];
+		image.pitches[1] = pitches[1];
+		break;
+	default:
+		image.format = OMAP_YUV_I420;
+		image.planes[1] = buf + offsets[id == FOURCC_YV12 ? 2 : 1];
+		image.planes[2] = buf + offsets[id == FOURCC_YV12 ? 1 : 2];
+		image.pitches[1] = pitches[1];
+		image.pitches[2] = pitches[2];
+		break;
+	}
+
+	scale.src_x = src_x << 16;
+	scale.src_y = src_y << 16;
+	scale.src_w = src_w << 16;
+	scale.src_h = src_h << 16;
+	scale.dst_w = drw_w;
+	scale.dst_h = drw_h;
+
+	box = *RegionExtents(clipBoxes);
+	box.x1 += xoff;
+	box.y1 += yoff;
+	box.x2 += xoff;
+	box.y2 += yoff;
+	/* with ShadowFB, the root pixmap is plain memory, without a bo */
+	bo = OMAPPixmapBo(pPixmap);
+	if (bo) {
+		OMAPEXAWaitBo(pScrn, bo);
+		if (!OMAPPrepareAccessBox(pPixmap, EXA_PREPARE_DEST, &box))
+			return BadAlloc;
+	} else if (!pPixmap->devPrivate.ptr) {
+		return BadAlloc;
+	}
+
+	/* Report the damage up front, as the damage layer does for other
+	 * rendering, so that ShadowFB lets a flush still reading the clip
+	 * finish before it is overwritten.
+	 */
+	DamageDamageRegion(pDraw, clipBoxes);
+
+	for (; nBox--; pBox++) {
+		int x1 = max(pBox->x1, drw_x), x2 = min(pBox->x2, drw_x + drw_w);
+		int y1 = max(pBox->y1, drw_y), y2 = min(pBox->y2, drw_y + drw_h);
+		uint8_t *dst;
+
+		if (x1 >= x2 || y1 >= y2)
+			continue;
+
+		dst = (uint8_t *)pPixmap->devPrivate.ptr +
+				(y1 + yoff) * pPixmap->devKind + (x1 + xoff) * 4;
+		if (omap_yuv_to_xrgb_bands(pOMAP->video->workers, &image,
+				&scale, x1 - drw_x, y1 - drw_y, x2 - drw_x,
+				y2 - drw_y, dst, pPixmap->devKind))
+			ret = BadAlloc;
+	}
+
+	if (bo)
+		OMAPFinishAccess(pPixmap, EXA_PREPARE_DEST);
+	return ret;
+}
+
+static int
+PutImage(ScrnInfoPtr pScrn, short src_x, short src_y, short drw_x,
+		short drw_y, short src_w, short src_h, short drw_w, short drw_h,
+		int id, unsigned char *buf, short width, short height,
+		Bool sync, RegionPtr clipBoxes, pointer data, DrawablePtr pDraw)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_video_port *port = data;
+	BoxRec dst = { drw_x, drw_y, drw_x + drw_w, drw_y + drw_h };
+	INT32 x1 = src_x, x2 = src_x + src_w;
+	INT32 y1 = src_y, y2 = src_y + src_h;
+	xf86CrtcPtr crtc = NULL;
+	struct omap_bo *bo;
+	uint32_t format;
+
+	if (width > VIDEO_MAX_SIZE || height > VIDEO_MAX_SIZE)
+		return BadAlloc;
+
+	/*
+	 * A plane only clips to a rectangle, so the video is cropped to the
+	 * extents of the visible part of the window, and goes over windows
+	 * stacked above it.  The source comes back in 16.16 fixed point, as
+	 * drmModeSetPlane() wants it.
+	 */
+	if (!xf86XVClipVideoHelper(&dst, &x1, &x2, &y1, &y2, clipBoxes,
+			width, height))
+		return Success;
+
+	format = PlaneFormat(port, id);
+	if (format)
+		crtc = BestCrtc(pScrn, port, &dst);
+	if (!crtc)
+		goto cpu;
+
+	if (!AllocBos(pScrn, port, (width + 1) & ~1, (height + 1) & ~1,
+			format)) {
+		ERROR_MSG("[PLANE:%u] video buffer allocation failed",
+				port->plane_id);
+		goto cpu;
+	}
+
+	bo = port->bo[port->back];
+	if (!CopyImage(bo, format, id, buf, width, height))
+		return BadAlloc;
+
+	if (drmModeSetPlane(pOMAP->drmFD, port->plane_id,
+			drmmode_crtc_id(crtc), omap_bo_fb(bo), 0,
+			dst.x1 - crtc->x, dst.y1 - crtc->y,
+			dst.x2 - dst.x1, dst.y2 - dst.y1,
+			x1, y1, x2 - x1, y2 - y1)) {
+		ERROR_MSG("[PLANE:%u] [CRTC:%u] set plane failed: %s",
+				port->plane_id, drmmode_crtc_id(crtc),
+				strerror(errno));
+		goto cpu;
+	}
+
+	port->crtc = crtc;
+	port->back = !port->back;
+	return Success;
+
+cpu:
+	StopVideo(pScrn, port, FALSE);
+	return PutImageCPU(pScrn, src_x, src_y, drw_x, drw_y, src_w, src_h,
+			drw_w, drw_h, id, buf, width, height, clipBoxes, pDraw);
+}
+
+/* Without the universal planes cap, all planes listed are overlays */
+static Bool
+IsOverlay(int fd, uint32_t plane_id)
+{
+	drmModeObjectPropertiesPtr props;
+	Bool overlay = TRUE;
+	uint32_t i;
+
+	props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return TRUE;
+
+	for (i = 0; i < props->count_props; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(fd,
+				props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, "type"))
+			overlay = props->prop_values[i] ==
+					DRM_PLANE_TYPE_OVERLAY;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return overlay;
+}
+
+/*
+ * Set up an Xv adaptor with a port for each overlay plane that takes NV12,
+ * YUV420 or YUYV, and a few more that convert on the CPU.
+ */
+Bool
+OMAPVideoScreenInit(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_video *video;
+	XF86VideoAdaptorPtr adaptor;
+	drmModePlaneResPtr plane_res;
+	uint32_t i, j, nplanes;
+	int nplane_ports;
+
+	/* kernels without planes still get the CPU ports */
+	plane_res = drmModeGetPlaneResources(pOMAP->drmFD);
+	nplanes = plane_res ? plane_res->count_planes : 0;
+
+	video = calloc(1, sizeof(*video));
+	if (!video)
+		goto fail;
+	video->ports = calloc(nplanes + VIDEO_CPU_PORTS,
+			sizeof(*video->ports));
+	if (!video->ports)
+		goto fail;
+
+	for (i = 0; i < nplanes; i++) {
+		struct omap_video_port *port = &video->ports[video->nports];
+		drmModePlanePtr plane;
+
+		if (!IsOverlay(pOMAP->drmFD, plane_res->planes[i]))
+			continue;
+		plane = drmModeGetPlane(pOMAP->drmFD, plane_res->planes[i]);
+		if (!plane)
+			continue;
+
+		for (j = 0; j < plane->count_formats; j++) {
+			if (plane->formats[j] == DRM_FORMAT_NV12)
+				port->nv12 = TRUE;
+			if (plane->formats[j] == DRM_FORMAT_YUV420)
+				port->yuv420 = TRUE;
+			if (plane->formats[j] == DRM_FORMAT_YUYV)
+				port->yuyv = TRUE;
+		}
+		port->plane_id = plane->plane_id;
+		port->possible_crtcs = plane->possible_crtcs;
+		drmModeFreePlane(plane);
+
+		if (port->nv12 || port->yuv420 || port->yuyv)
+			video->nports++;
+		else
+			memset(port, 0, sizeof(*port));
+	}
+	if (plane_res)
+		drmModeFreePlaneResources(plane_res);
+	plane_res = NULL;
+
+	/* the ports past the planes are left zeroed, without a plane */
+	nplane_ports = video->nports;
+	video->nports += VIDEO_CPU_PORTS;
+	video->workers = omap_workers_new();
+
+	adaptor = xf86XVAllocateVideoAdaptorRec(pScrn);
+	if (!adaptor)
+		goto fail;
+	adaptor->pPortPrivates = calloc(video->nports, sizeof(DevUnion));
+	if (!adaptor->pPortPrivates) {
+		xf86XVFreeVideoAdaptorRec(adaptor);
+		goto fail;
+	}
+	for (i = 0; i < video->nports; i++)
+		adaptor->pPortPrivates[i].ptr = &video->ports[i];
+
+	adaptor->type = XvWindowMask | XvInputMask | XvImageMask;
+	adaptor->flags = VIDEO_OVERLAID_IMAGES;
+	adaptor->name = "ARMSOC Video";
+	adaptor->nEncodings = ARRAY_SIZE(Encodings);
+	adaptor->pEncodings = Encodings;
+	adaptor->nFormats = ARRAY_SIZE(Formats);
+	adaptor->pFormats = Formats;
+	adaptor->nPorts = video->nports;
+	adaptor->nAttributes = 0;
+	adaptor->pAttributes = NULL;
+	adaptor->nImages = ARRAY_SIZE(Images);
+	adaptor->pImages = Images;
+	adaptor->StopVideo = StopVideo;
+	adaptor->SetPortAttribute = SetPortAttribute;
+	adaptor->GetPortAttribute = GetPortAttribute;
+	adaptor->QueryBestSize = QueryBestSize;
+	adaptor->PutImage = PutImage;
+	adaptor->QueryImageAttributes = QueryImageAttributes;
+
+	video->adaptor = adaptor;
+	if (!xf86XVScreenInit(pScreen, &adaptor, 1)) {
+		free(adaptor->pPortPrivates);
+		xf86XVFreeVideoAdaptorRec(adaptor);
+		video->adaptor = NULL;
+		goto fail;
+	}
+
+	INFO_MSG("Xv with %d overlay plane(s) and %d CPU port(s)",
+			nplane_ports, VIDEO_CPU_PORTS);
+	pOMAP->video = video;
+	return TRUE;
+
+fail:
+	if (plane_res)
+		drmModeFreePlaneResources(plane_res);
+	if (video) {
+		omap_workers_free(video->workers);
+		free(video->ports);
+	}
+	free(video);
+	return FALSE;
+}
+
+/* Turn the planes off while we are still DRM master */
+void
+OMAPVideoStop(ScrnInfoPtr pScrn)
+{
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	int i;
+
+	if (!pOMAP->video)
+		return;
+
+	for (i = 0; i < pOMAP->video->nports; i++)
+		StopVideo(pScrn, &pOMAP->video->ports[i], TRUE);
+}
+
+/* Called once the Xv layer, which stops the ports, has closed too */
+void
+OMAPVideoCloseScreen(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	OMAPPtr pOMAP = OMAPPTR(pScrn);
+	struct omap_video *video = pOMAP->video;
+	int i;
+
+	if (!video)
+		return;
+
+	for (i = 0; i < video->nports; i++)
+		FreeBos(&video->ports[i]);
+	free(video->adaptor->pPortPrivates);
+	xf86XVFreeVideoAdaptorRec(video->adaptor);
+	omap_workers_free(video->workers);
+	free(video->ports);
+	free(video);
+	pOMAP->video = NULL;
+}
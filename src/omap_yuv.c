@@ -0,0 +1,514 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * YUV to x8r8g8b8 conversion with bilinear scaling, for showing video that
+ * did not get an overlay plane.  Each row of the picture is made in three
+ * steps: the two nearest source rows are blended together, the result is
+ * resampled horizontally to one Y, U and V byte per output pixel, and those
+ * are converted with BT.601 limited range coefficients in 6 bit fixed point
+ * (luma gets one more bit, so that white comes out as 255).
+ * The blending and the conversion are vectorized like omap_composite.c.
+ *
+ * This does not depend on the X server, so it also builds as a benchmark:
+ *
+ *   cc -O2 -DOMAP_YUV_BENCHMARK -o yuv-bench omap_yuv.c omap_workers.c -lpthread
+ *   ./yuv-bench [src_w src_h dst_w dst_h [frames]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OMAP_YUV_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define OMAP_YUV_SSE2 1
+#endif
+
+#include "omap_workers.h"
+#include "omap_yuv.h"
+
+#define YUV_MAX_BANDS		16
+#define YUV_MIN_BAND_ROWS	16
+
+/* The two source samples a pixel is made of, and the weight of the second */
+struct sample {
+	int i0, i1;
+	int frac;
+};
+
+static inline uint8_t clamp_un8(int x)
+{
+	return x < 0 ? 0 : x > 0xff ? 0xff : x;
+}
+
+static inline uint32_t yuv_pixel(int y, int u, int v)
+{
+	int l = ((y > 16 ? y - 16 : 0) * 149 >> 1) + 32;
+
+	u -= 128;
+	v -= 128;
+	return 0xff000000 |
+		clamp_un8((l + 102 * v) >> 6) << 16 |
+		clamp_un8((l - 52 * v - 25 * u) >> 6) << 8 |
+		clamp_un8((l + 129 * u) >> 6);
+}
+
+#if defined(OMAP_YUV_NEON)
+/* a * (256 - f) + b * f, for f from 1 to 255 */
+static int blend_row(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		int f, int n)
+{
+	uint8x8_t fa = vdup_n_u8(256 - f), fb = vdup_n_u8(f);
+	int done = 0;
+
+	for (; n >= 16; n -= 16, done += 16) {
+		uint8x16_t x = vld1q_u8(a + done), y = vld1q_u8(b + done);
+		uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(x), fa),
+				vget_low_u8(y), fb);
+		uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(x), fa),
+				vget_high_u8(y), fb);
+
+		vst1q_u8(dst + done, vcombine_u8(vrshrn_n_u16(lo, 8),
+				vrshrn_n_u16(hi, 8)));
+	}
+	return done;
+}
+
+/* eight pixels at a time, stored interleaved as b, g, r and x */
+static int convert_row(uint32_t *dst, const uint8_t *y, const uint8_t *u,
+		const uint8_t *v, int n)
+{
+	int done = 0;
+
+	for (; n >= 8; n -= 8, done += 8) {
+		int16x8_t l = vreinterpretq_s16_u16(vshrq_n_u16(vmull_u8(
+				vqsub_u8(vld1_u8(y + done), vdup_n_u8(16)),
+				vdup_n_u8(149)), 1));
+		int16x8_t cu = vreinterpretq_s16_u16(
+				vsubl_u8(vld1_u8(u + done), vdup_n_u8(128)));
+		int16x8_t cv = vreinterpretq_s16_u16(
+				vsubl_u8(vld1_u8(v + done), vdup_n_u8(128)));
+		uint8x8x4_t d;
+
+		d.val[0] = vqrshrun_n_s16(vqaddq_s16(l, vmulq_n_s16(cu, 129)), 6);
+		d.val[1] = vqrshrun_n_s16(vqsubq_s16(l, vaddq_s16(
+				vmulq_n_s16(cv, 52), vmulq_n_s16(cu, 25))), 6);
+		d.val[2] = vqrshrun_n_s16(vqaddq_s16(l, vmulq_n_s16(cv, 102)), 6);
+		d.val[3] = vdup_n_u8(0xff);
+		vst4_u8((uint8_t *)(dst + done), d);
+	}
+	return done;
+}
+#elif defined(OMAP_YUV_SSE2)
+static int blend_row(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		int f, int n)
+{
+	__m128i fa = _mm_set1_epi16(256 - f), fb = _mm_set1_epi16(f);
+	__m128i round = _mm_set1_epi16(0x80), zero = _mm_setzero_si128();
+	int done = 0;
+
+	for (; n >= 16; n -= 16, done += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + done));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + done));
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), fa),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), fb)),
+				round);
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), fa),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(y, zero), fb)),
+				round);
+
+		_mm_storeu_si128((__m128i *)(dst + done), _mm_packus_epi16(
+				_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	return done;
+}
+
+static inline __m128i load_un8x8(const uint8_t *p)
+{
+	return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p),
+			_mm_setzero_si128());
+}
+
+/* (x + 32) >> 6, saturated to 8 bits, in the low half */
+static inline __m128i pack_un8(__m128i x)
+{
+	x = _mm_srai_epi16(_mm_adds_epi16(x, _mm_set1_epi16(32)), 6);
+	return _mm_packus_epi16(x, x);
+}
+
+static int convert_row(uint32_t *dst, const uint8_t *y, const uint8_t *u,
+		const uint8_t *v, int n)
+{
+	__m128i c128 = _mm_set1_epi16(128);
+	int done = 0;
+
+	for (; n >= 8; n -= 8, done += 8) {
+		__m128i l = _mm_srli_epi16(_mm_mullo_epi16(_mm_subs_epu16(
+				load_un8x8(y + done), _mm_set1_epi16(16)),
+				_mm_set1_epi16(149)), 1);
+		__m128i cu = _mm_sub_epi16(load_un8x8(u + done), c128);
+		__m128i cv = _mm_sub_epi16(load_un8x8(v + done), c128);
+		__m128i b, g, r, bg, rx;
+
+		b = pack_un8(_mm_adds_epi16(l,
+				_mm_mullo_epi16(cu, _mm_set1_epi16(129))));
+		g = pack_un8(_mm_subs_epi16(l, _mm_add_epi16(
+				_mm_mullo_epi16(cv, _mm_set1_epi16(52)),
+				_mm_mullo_epi16(cu, _mm_set1_epi16(25)))));
+		r = pack_un8(_mm_adds_epi16(l,
+				_mm_mullo_epi16(cv, _mm_set1_epi16(102))));
+		bg = _mm_unpacklo_epi8(b, g);
+		rx = _mm_unpacklo_epi8(r, _mm_set1_epi8(0xff));
+		_mm_storeu_si128((__m128i *)(dst + done),
+				_mm_unpacklo_epi16(bg, rx));
+		_mm_storeu_si128((__m128i *)(dst + done + 4),
+				_mm_unpackhi_epi16(bg, rx));
+	}
+	return done;
+}
+#else
+static int blend_row(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		int f, int n)
+{
+	return 0;
+}
+
+static int convert_row(uint32_t *dst, const uint8_t *y, const uint8_t *u,
+		const uint8_t *v, int n)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Where destination pixels @from to @to of @dst_n sample a plane of @n
+ * samples, for the source interval @pos, @len.  The plane is subsampled by
+ * @shift, with its samples @bias luma samples after the luma ones.
+ */
+static void sample_positions(struct sample *s, int from, int to, int dst_n,
+		int32_t pos, int32_t len, int n, int shift, int32_t bias)
+{
+	int i;
+
+	for (i = from; i < to; i++, s++) {
+		/* pixel centres, in 16.16 sample indices */
+		int64_t p = pos - 0x8000 +
+				(int64_t)(2 * i + 1) * len / (2 * dst_n);
+
+		p = (p - bias) >> shift;
+		if (p < 0)
+			p = 0;
+		if (p >> 16 >= n - 1) {
+			s->i0 = s->i1 = n - 1;
+			s->frac = 0;
+		} else {
+			s->i0 = p >> 16;
+			s->i1 = s->i0 + 1;
+			s->frac = (p >> 8) & 0xff;
+		}
+	}
+}
+
+/*
+ * Row @s of @plane, blended over bytes @lo to @hi into @tmp when it falls
+ * between two rows.  The result is indexed like a row of the plane.
+ */
+static const uint8_t *vertical(uint8_t *tmp, const uint8_t *plane, int pitch,
+		const struct sample *s, int lo, int hi)
+{
+	const uint8_t *a = plane + s->i0 * pitch;
+	const uint8_t *b = plane + s->i1 * pitch;
+	int i;
+
+	if (!s->frac)
+		return a;
+	for (i = lo + blend_row(tmp + lo, a + lo, b + lo, s->frac, hi - lo);
+			i < hi; i++)
+		tmp[i] = (a[i] * (256 - s->frac) + b[i] * s->frac + 0x80) >> 8;
+	return tmp;
+}
+
+/* Resample every @stride byte of @row to @n pixels */
+static void horizontal(uint8_t *dst, const uint8_t *row, int stride,
+		const struct sample *s, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++, s++)
+		dst[i] = (row[s->i0 * stride] * (256 - s->frac) +
+				row[s->i1 * stride] * s->frac + 0x80) >> 8;
+}
+
+int omap_yuv_to_xrgb(const struct omap_yuv_image *image,
+		const struct omap_yuv_scale *scale, int x1, int y1, int x2, int y2,
+		uint8_t *dst, int dst_pitch)
+{
+	const int n = x2 - x1;
+	const int cw = (image->width + 1) / 2, ch = (image->height + 1) / 2;
+	const int packed = image->format == OMAP_YUV_YUYV;
+	const int row_bytes = packed ? cw * 4 : image->width;
+	struct sample *xs, *xcs;
+	uint8_t *mem, *yrow, *urow, *vrow, *ytmp, *ctmp;
+	int ylo, yhi, clo, chi, identity, y;
+
+	if (n <= 0 || y2 <= y1)
+		return 0;
+
+	mem = malloc(2 * n * sizeof(*xs) + 3 * n + row_bytes + 2 * cw);
+	if (!mem)
+		return -1;
+	xs = (struct sample *)mem;
+	xcs = xs + n;
+	yrow = (uint8_t *)(xcs + n);
+	urow = yrow + n;
+	vrow = urow + n;
+	ytmp = vrow + n;
+	ctmp = ytmp + row_bytes;
+
+	sample_positions(xs, x1, x2, scale->dst_w, scale->src_x, scale->src_w,
+			image->width, 0, 0);
+	sample_positions(xcs, x1, x2, scale->dst_w, scale->src_x, scale->src_w,
+			cw, 1, 0);
+	ylo = xs[0].i0;
+	yhi = xs[n - 1].i1 + 1;
+	clo = xcs[0].i0;
+	chi = xcs[n - 1].i1 + 1;
+
+	/* unscaled luma at whole pixel offsets is used in place */
+	identity = !packed && !(scale->src_x & 0xffff) &&
+			scale->src_w == (int64_t)scale->dst_w << 16;
+
+	for (y = y1; y < y2; y++, dst += dst_pitch) {
+		uint32_t *d = (uint32_t *)dst;
+		const uint8_t *ly = yrow, *row;
+		struct sample sy, sc;
+		int i;
+
+		sample_positions(&sy, y, y + 1, scale->dst_h, scale->src_y,
+				scale->src_h, image->height, 0, 0);
+
+		switch (image->format) {
+		case OMAP_YUV_I420:
+		case OMAP_YUV_NV12:
+			/* 4:2:0 chroma sits between two luma rows */
+			sample_positions(&sc, y, y + 1, scale->dst_h,
+					scale->src_y, scale->src_h, ch, 1, 0x8000);
+			row = vertical(ytmp, image->planes[0],
+					image->pitches[0], &sy, ylo, yhi);
+			if (identity)
+				ly = row + ylo;
+			else
+				horizontal(yrow, row, 1, xs, n);
+			if (image->format == OMAP_YUV_NV12) {
+				row = vertical(ctmp, image->planes[1],
+						image->pitches[1], &sc,
+						2 * clo, 2 * chi);
+				horizontal(urow, row, 2, xcs, n);
+				horizontal(vrow, row + 1, 2, xcs, n);
+			} else {
+				row = vertical(ctmp, image->planes[1],
+						image->pitches[1], &sc, clo, chi);
+				horizontal(urow, row, 1, xcs, n);
+				row = vertical(ctmp + cw, image->planes[2],
+						image->pitches[2], &sc, clo, chi);
+				horizontal(vrow, row, 1, xcs, n);
+			}
+			break;
+		case OMAP_YUV_YUYV:
+			row = vertical(ytmp, image->planes[0],
+					image->pitches[0], &sy,
+					2 * ylo < 4 * clo ? 2 * ylo : 4 * clo,
+					4 * chi > 2 * yhi ? 4 * chi : 2 * yhi);
+			horizontal(yrow, row, 2, xs, n);
+			horizontal(urow, row + 1, 4, xcs, n);
+			horizontal(vrow, row + 3, 4, xcs, n);
+			break;
+		}
+
+		for (i = convert_row(d, ly, urow, vrow, n); i < n; i++)
+			d[i] = yuv_pixel(ly[i], urow[i], vrow[i]);
+	}
+
+	free(mem);
+	return 0;
+}
+
+struct yuv_band {
+	const struct omap_yuv_image *image;
+	const struct omap_yuv_scale *scale;
+	int x1, y1, x2, y2;
+	uint8_t *dst;
+	int dst_pitch;
+	int ret;
+};
+
+static void yuv_band_run(void *data)
+{
+	struct yuv_band *band = data;
+
+	band->ret = omap_yuv_to_xrgb(band->image, band->scale, band->x1,
+			band->y1, band->x2, band->y2, band->dst, band->dst_pitch);
+}
+
+int omap_yuv_to_xrgb_bands(struct omap_workers *workers,
+		const struct omap_yuv_image *image,
+		const struct omap_yuv_scale *scale, int x1, int y1, int x2, int y2,
+		uint8_t *dst, int dst_pitch)
+{
+	struct yuv_band bands[YUV_MAX_BANDS];
+	int nbands = workers ? omap_workers_count(workers) + 1 : 1;
+	int rows, i, ret = 0;
+
+	if (nbands > YUV_MAX_BANDS)
+		nbands = YUV_MAX_BANDS;
+	if (nbands > (y2 - y1) / YUV_MIN_BAND_ROWS)
+		nbands = (y2 - y1) / YUV_MIN_BAND_ROWS;
+	if (nbands <= 1)
+		return omap_yuv_to_xrgb(image, scale, x1, y1, x2, y2, dst,
+				dst_pitch);
+
+	rows = (y2 - y1 + nbands - 1) / nbands;
+	for (i = 0; i < nbands; i++) {
+		struct yuv_band *band = &bands[i];
+
+		band->image = image;
+		band->scale = scale;
+		band->x1 = x1;
+		band->x2 = x2;
+		band->y1 = y1 + i * rows;
+		band->y2 = band->y1 + rows < y2 ? band->y1 + rows : y2;
+		band->dst = dst + i * rows * dst_pitch;
+		band->dst_pitch = dst_pitch;
+		band->ret = 0;
+		/* the last band runs here, while the workers do the rest */
+		if (i < nbands - 1)
+			omap_workers_queue(workers, yuv_band_run, band);
+		else
+			yuv_band_run(band);
+	}
+	omap_workers_wait(workers);
+
+	for (i = 0; i < nbands; i++)
+		if (bands[i].ret)
+			ret = bands[i].ret;
+	return ret;
+}
+
+#ifdef OMAP_YUV_BENCHMARK
+#include <stdio.h>
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = { "I420", "NV12", "YUYV" };
+	int src_w = 1920, src_h = 1080, dst_w = 1920, dst_h = 1080;
+	int frames = 100, f, i, threads;
+	struct omap_workers *workers = omap_workers_new();
+	struct omap_yuv_scale scale;
+	uint8_t *src, *dst;
+
+	if (argc >= 5) {
+		src_w = atoi(argv[1]) & ~1;
+		src_h = atoi(argv[2]) & ~1;
+		dst_w = atoi(argv[3]);
+		dst_h = atoi(argv[4]);
+	}
+	if (argc >= 6)
+		frames = atoi(argv[5]);
+	if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0 ||
+			frames <= 0) {
+		fprintf(stderr, "usage: %s [src_w src_h dst_w dst_h [frames]]\n",
+				argv[0]);
+		return 1;
+	}
+
+	src = malloc(src_w * src_h * 2);
+	dst = malloc(dst_w * dst_h * 4);
+	if (!src || !dst)
+		return 1;
+	for (i = 0; i < src_w * src_h * 2; i++)
+		src[i] = rand();
+
+	scale.src_x = scale.src_y = 0;
+	scale.src_w = src_w << 16;
+	scale.src_h = src_h << 16;
+	scale.dst_w = dst_w;
+	scale.dst_h = dst_h;
+
+	for (i = OMAP_YUV_I420; i <= OMAP_YUV_YUYV; i++) {
+		struct omap_yuv_image image;
+
+		image.format = i;
+		image.width = src_w;
+		image.height = src_h;
+		if (i == OMAP_YUV_YUYV) {
+			image.planes[0] = src;
+			image.pitches[0] = src_w * 2;
+		} else {
+			image.planes[0] = src;
+			image.pitches[0] = src_w;
+			image.planes[1] = src + src_w * src_h;
+			image.pitches[1] = i == OMAP_YUV_NV12 ? src_w : src_w / 2;
+			image.planes[2] = image.planes[1] + src_w / 2 * src_h / 2;
+			image.pitches[2] = src_w / 2;
+		}
+
+		for (threads = 0; threads < (workers ? 2 : 1); threads++) {
+			double start = now(), t;
+
+			for (f = 0; f < frames; f++)
+				omap_yuv_to_xrgb_bands(threads ? workers : NULL,
+						&image, &scale, 0, 0, dst_w, dst_h,
+						dst, dst_w * 4);
+			t = (now() - start) / frames;
+			printf("%s %dx%d -> %dx%d, %d thread%s: %.2f ms/frame, %.1f fps\n",
+					names[i], src_w, src_h, dst_w, dst_h,
+					threads ? omap_workers_count(workers) + 1 : 1,
+					threads ? "s" : "", t * 1e3, 1 / t);
+		}
+	}
+
+	if (workers)
+		omap_workers_free(workers);
+	free(src);
+	free(dst);
+	return 0;
+}
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2014 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef OMAP_YUV_H_
+#define OMAP_YUV_H_
+
+#include <stdint.h>
+
+struct omap_workers;
+
+enum omap_yuv_format {
+	OMAP_YUV_I420,	/* Y plane, then U and V planes at half size */
+	OMAP_YUV_NV12,	/* Y plane, then interleaved UV at half size */
+	OMAP_YUV_YUYV,	/* packed Y0 U Y1 V, chroma at half width */
+};
+
+/* A BT.601 limited range video frame in client memory */
+struct omap_yuv_image {
+	enum omap_yuv_format format;
+	int width, height;
+	const uint8_t *planes[3];
+	int pitches[3];
+};
+
+/*
+ * The source rectangle, in 16.16 fixed point image coordinates, and the
+ * size in pixels it is scaled to.
+ */
+struct omap_yuv_scale {
+	int32_t src_x, src_y, src_w, src_h;
+	int dst_w, dst_h;
+};
+
+/*
+ * Convert @image to x8r8g8b8, scaled bilinearly as @scale says.  Only the
+ * (@x1, @y1) - (@x2, @y2) part of the scaled picture is written, with
+ * pixel (@x1, @y1) at @dst, so clip boxes and bands of rows of one frame
+ * can be converted separately.  Returns -1 if out of memory.
+ */
+int omap_yuv_to_xrgb(const struct omap_yuv_image *image,
+		const struct omap_yuv_scale *scale, int x1, int y1, int x2, int y2,
+		uint8_t *dst, int dst_pitch);
+
+/* Same, split into bands of rows over @workers, which may be NULL */
+int omap_yuv_to_xrgb_bands(struct omap_workers *workers,
+		const struct omap_yuv_image *image,
+		const struct omap_yuv_scale *scale, int x1, int y1, int x2, int y2,
+		uint8_t *dst, int dst_pitch);
+
+#endif /* OMAP_YUV_H_ */